@@ -0,0 +1,221 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include "cold_redundancy.hpp"
+#include "dbus_fixture.hpp"
+#include "sim_i2c_transport.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Access to ColdRedundancy internals for the benchmark and test harnesses.
+struct ColdRedundancyAccess
+{
+    static void setWarmHold(ColdRedundancy& cr, std::chrono::milliseconds hold)
+    {
+        cr.warmRedundantHold = hold;
+    }
+    static boost::asio::awaitable<void> configCR(ColdRedundancy& cr,
+                                                 bool reConfig)
+    {
+        return cr.configCR(reConfig);
+    }
+    static boost::asio::awaitable<void> rotateCR(ColdRedundancy& cr)
+    {
+        return cr.rotateCR();
+    }
+    static boost::asio::awaitable<void> keepAlive(ColdRedundancy& cr)
+    {
+        return cr.keepAlive();
+    }
+    static void addPresence(ColdRedundancy& cr, uint8_t bus,
+                            const std::vector<uint8_t>& addresses)
+    {
+        auto& presence = cr.presenceBuses[bus];
+        presence.addresses = addresses;
+        presence.present.assign(addresses.size(), false);
+        presence.probe = *i2cResolveProbe(bus, PresenceProbe::automatic);
+    }
+    static void useSubTreeDiscovery(ColdRedundancy& cr)
+    {
+        cr.discoveryMode = ColdRedundancy::DiscoveryMode::subTree;
+    }
+    static size_t psuCount(const ColdRedundancy& cr)
+    {
+        return cr.powerSupplies.size();
+    }
+    static const PSURegistry& psus(const ColdRedundancy& cr)
+    {
+        return cr.powerSupplies;
+    }
+    static bool idle(const ColdRedundancy& cr)
+    {
+        return cr.coldRedundancyStatus() != ColdRedundancy::Status::inProgress;
+    }
+};
+
+// Run the io_service until done() returns true or the timeout expires.
+template <typename Predicate>
+bool runUntil(boost::asio::io_service& io, Predicate&& done,
+              std::chrono::seconds timeout = std::chrono::seconds(30))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!done())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        io.run_one_for(std::chrono::milliseconds(10));
+        if (io.stopped())
+        {
+            io.restart();
+        }
+    }
+    return true;
+}
+
+// Run task on io until it has finished. Throws when it does not finish in
+// time and rethrows what it threw.
+inline void runCoroutine(boost::asio::io_service& io,
+                         boost::asio::awaitable<void> task)
+{
+    struct Result
+    {
+        bool done = false;
+        std::exception_ptr error;
+    };
+    // Shared with the completion handler, which outlives a timeout.
+    auto result = std::make_shared<Result>();
+    boost::asio::co_spawn(io, std::move(task),
+                          [result](std::exception_ptr error) {
+                              result->done = true;
+                              result->error = error;
+                          });
+    if (!runUntil(io, [&result]() { return result->done; }))
+    {
+        throw std::runtime_error("Coroutine did not finish");
+    }
+    if (result->error)
+    {
+        std::rethrow_exception(result->error);
+    }
+}
+
+template <typename Function>
+double timeSeconds(Function&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+// Spread PSUs over buses of eight, as on multi-shelf systems.
+inline std::pair<uint8_t, uint8_t> psuLocation(size_t index)
+{
+    return {static_cast<uint8_t>(index / 8),
+            static_cast<uint8_t>(0x58 + index % 8)};
+}
+
+// Add count PSUs, PSU1 onwards at psuLocation(), to the fixture inventory
+// and to a simulated farm that is installed as the I2C transport. The farm
+// stays owned by the transport.
+inline SimulatedI2CTransport& installFarm(
+    DbusFixture& fixture, size_t count,
+    std::chrono::microseconds latency = std::chrono::microseconds(0))
+{
+    auto sim = std::make_unique<SimulatedI2CTransport>();
+    SimulatedI2CTransport& farm = *sim;
+    farm.setLatency(latency);
+    for (size_t index = 0; index < count; index++)
+    {
+        auto [bus, address] = psuLocation(index);
+        fixture.addPSU("PSU" + std::to_string(index + 1), bus, address);
+        farm.addPSU(bus, address);
+    }
+    setI2CTransport(std::move(sim));
+    return farm;
+}
+
+// The daemon wired up as in redundancy_main.cpp, on its own io_service and
+// connection to the fixture bus. The fixture stand-ins are served on the same
+// io_service while the daemon exists. The warm hold is disabled.
+struct DaemonUnderTest
+{
+    explicit DaemonUnderTest(DbusFixture& fixture) :
+        fixture(fixture), conn(connectDaemon(fixture, io)), server(conn),
+        cr(io, server, conn, matches)
+    {
+        ColdRedundancyAccess::setWarmHold(cr, std::chrono::milliseconds(0));
+    }
+    ~DaemonUnderTest()
+    {
+        fixture.detach();
+    }
+    DaemonUnderTest(const DaemonUnderTest&) = delete;
+    DaemonUnderTest& operator=(const DaemonUnderTest&) = delete;
+
+    void run(boost::asio::awaitable<void> task)
+    {
+        runCoroutine(io, std::move(task));
+    }
+
+    bool waitForPSUs(size_t count)
+    {
+        return runUntil(io, [this, count]() {
+            return ColdRedundancyAccess::psuCount(cr) >= count &&
+                   ColdRedundancyAccess::idle(cr);
+        });
+    }
+
+    static std::shared_ptr<sdbusplus::asio::connection>
+        connectDaemon(DbusFixture& fixture, boost::asio::io_service& io)
+    {
+        fixture.attach(io);
+        auto conn = fixture.connect(io);
+        conn->request_name("xyz.openbmc_project.PSURedundancy");
+        return conn;
+    }
+
+    DbusFixture& fixture;
+    boost::asio::io_service io;
+    std::shared_ptr<sdbusplus::asio::connection> conn;
+    sdbusplus::asio::object_server server;
+    std::vector<std::unique_ptr<sdbusplus::bus::match::match>> matches;
+    ColdRedundancy cr;
+};
+
+inline std::optional<PSUState> psuState(const ColdRedundancy& cr,
+                                        const std::string& name)
+{
+    for (const auto& psu : ColdRedundancyAccess::psus(cr))
+    {
+        if (psu.name == name)
+        {
+            return psu.state;
+        }
+    }
+    return std::nullopt;
+}
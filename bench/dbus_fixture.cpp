@@ -0,0 +1,384 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "dbus_fixture.hpp"
+
+#include "utility.hpp"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <systemd/sd-bus.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static const constexpr char* busConfig =
+    "<!DOCTYPE busconfig PUBLIC "
+    "\"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\" "
+    "\"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+    "<busconfig>\n"
+    "  <type>session</type>\n"
+    "  <listen>unix:dir=%DIR%</listen>\n"
+    "  <auth>EXTERNAL</auth>\n"
+    "  <policy context=\"default\">\n"
+    "    <allow send_destination=\"*\" eavesdrop=\"true\"/>\n"
+    "    <allow eavesdrop=\"true\"/>\n"
+    "    <allow own=\"*\"/>\n"
+    "  </policy>\n"
+    "</busconfig>\n";
+
+static const constexpr char* inventoryPrefix =
+    "/xyz/openbmc_project/inventory/system";
+static const constexpr char* decoratorService = "xyz.openbmc_project.PSUSensor";
+static const constexpr char* decoratorInterface =
+    "xyz.openbmc_project.State.Decorator.OperationalStatus";
+static const constexpr char* settingsPath =
+    "/xyz/openbmc_project/control/power_supply_redundancy";
+
+static std::string decoratorPath(const std::string& name)
+{
+    return "/xyz/openbmc_project/State/Decorator/" + name +
+           "_OperationalStatus";
+}
+
+DbusFixture::DbusFixture()
+{
+    char dirTemplate[] = "/tmp/psu-bench-XXXXXX";
+    if (::mkdtemp(dirTemplate) == nullptr)
+    {
+        throw std::runtime_error("mkdtemp failed");
+    }
+    tmpDir = dirTemplate;
+
+    std::string config = busConfig;
+    config.replace(config.find("%DIR%"), 5, tmpDir);
+    std::string configPath = tmpDir + "/bus.conf";
+    std::ofstream(configPath) << config;
+
+    int pipeFds[2];
+    if (::pipe(pipeFds) < 0)
+    {
+        throw std::runtime_error("pipe failed");
+    }
+    daemonPid = ::fork();
+    if (daemonPid < 0)
+    {
+        throw std::runtime_error("fork failed");
+    }
+    if (daemonPid == 0)
+    {
+        ::close(pipeFds[0]);
+        std::string configArg = "--config-file=" + configPath;
+        std::string printArg = "--print-address=" + std::to_string(pipeFds[1]);
+        ::execlp("dbus-daemon", "dbus-daemon", configArg.c_str(), "--nofork",
+                 printArg.c_str(), nullptr);
+        ::_exit(127);
+    }
+    ::close(pipeFds[1]);
+
+    char buf[512];
+    ssize_t len = 0;
+    while (len < static_cast<ssize_t>(sizeof(buf)) - 1)
+    {
+        ssize_t n = ::read(pipeFds[0], buf + len, sizeof(buf) - 1 - len);
+        if (n <= 0)
+        {
+            break;
+        }
+        len += n;
+        if (buf[len - 1] == '\n')
+        {
+            break;
+        }
+    }
+    ::close(pipeFds[0]);
+    if (len <= 1)
+    {
+        throw std::runtime_error("dbus-daemon did not start");
+    }
+    address.assign(buf, len - 1);
+}
+
+DbusFixture::~DbusFixture()
+{
+    detach();
+    if (daemonPid > 0)
+    {
+        ::kill(daemonPid, SIGTERM);
+        ::waitpid(daemonPid, nullptr, 0);
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(tmpDir, ec);
+}
+
+DbusFixture::Config DbusFixture::psuConfig(const std::string& name,
+                                           uint8_t bus, uint8_t address)
+{
+    Config config;
+    config.path = std::string(inventoryPrefix) + "/powersupply/" + name;
+    config.interface = "xyz.openbmc_project.Configuration.pmbus";
+    config.properties["Name"] = name;
+    config.properties["Bus"] = static_cast<uint64_t>(bus);
+    config.properties["Address"] = static_cast<uint64_t>(address);
+    return config;
+}
+
+void DbusFixture::addPSU(const std::string& name, uint8_t bus,
+                         uint8_t address, bool functional)
+{
+    configs.push_back(psuConfig(name, bus, address));
+    decorators[name] = functional;
+    psuCount++;
+}
+
+void DbusFixture::addPresence(uint8_t bus,
+                              const std::vector<uint64_t>& addresses)
+{
+    Config config;
+    config.path = std::string(inventoryPrefix) + "/chassis/PSU_Presence_" +
+                  std::to_string(bus);
+    config.interface = "xyz.openbmc_project.Configuration.PSUPresence";
+    config.properties["Name"] = "PSU_Presence_" + std::to_string(bus);
+    config.properties["Bus"] = static_cast<uint64_t>(bus);
+    config.properties["Address"] = addresses;
+    configs.push_back(std::move(config));
+}
+
+void DbusFixture::addFiller(size_t count)
+{
+    for (size_t index = 0; index < count; index++)
+    {
+        Config config;
+        config.path = std::string(inventoryPrefix) + "/board/Filler" +
+                      std::to_string(index);
+        config.interface = "xyz.openbmc_project.Configuration.TMP75";
+        config.properties["Name"] = "Filler" + std::to_string(index);
+        config.properties["Bus"] = static_cast<uint64_t>(index % 16);
+        config.properties["Address"] = static_cast<uint64_t>(0x48);
+        configs.push_back(std::move(config));
+    }
+}
+
+void DbusFixture::setRedundantCount(uint8_t count)
+{
+    redundantCount = count;
+}
+
+void DbusFixture::setRedundancyEnabled(bool enabled)
+{
+    redundancyEnabled = enabled;
+}
+
+void DbusFixture::setRotationMode(const std::string& mode)
+{
+    rotationMode = mode;
+}
+
+std::shared_ptr<sdbusplus::asio::connection>
+    DbusFixture::connect(boost::asio::io_service& io)
+{
+    sd_bus* bus = nullptr;
+    if (sd_bus_new(&bus) < 0 || sd_bus_set_address(bus, address.c_str()) < 0 ||
+        sd_bus_set_bus_client(bus, 1) < 0 || sd_bus_start(bus) < 0)
+    {
+        sd_bus_unref(bus);
+        throw std::runtime_error("failed to connect to " + address);
+    }
+    auto conn = std::make_shared<sdbusplus::asio::connection>(io, bus);
+    sd_bus_unref(bus);
+    return conn;
+}
+
+void DbusFixture::start(void)
+{
+    Config redundancy;
+    redundancy.path = std::string(inventoryPrefix) + "/chassis/PURedundancy";
+    redundancy.interface = "xyz.openbmc_project.Configuration.PURedundancy";
+    redundancy.properties["Name"] = std::string("PURedundancy");
+    redundancy.properties["RedundantCount"] = redundantCount;
+    if (!rotationMode.empty())
+    {
+        redundancy.properties["RotationMode"] = rotationMode;
+    }
+    configs.push_back(std::move(redundancy));
+
+    for (const auto& config : configs)
+    {
+        mapperObjects[config.path] = {entityManagerName, {config.interface}};
+    }
+    for (const auto& [name, functional] : decorators)
+    {
+        mapperObjects[decoratorPath(name)] = {decoratorService,
+                                              {decoratorInterface}};
+    }
+}
+
+void DbusFixture::setFunctional(const std::string& name, bool functional)
+{
+    auto find = interfaces.find(decoratorPath(name));
+    if (find != interfaces.end())
+    {
+        find->second->set_property("functional", functional);
+    }
+}
+
+// The decorator is added first, as PSUSensor does before Entity Manager
+// announces the configuration.
+void DbusFixture::insertPSU(const std::string& name, uint8_t bus,
+                            uint8_t address)
+{
+    Config config = psuConfig(name, bus, address);
+    mapperObjects[decoratorPath(name)] = {decoratorService,
+                                          {decoratorInterface}};
+    mapperObjects[config.path] = {entityManagerName, {config.interface}};
+    addDecorator(name, true);
+    addConfig(config);
+}
+
+void DbusFixture::removePSU(const std::string& name)
+{
+    for (const std::string& path :
+         {std::string(inventoryPrefix) + "/powersupply/" + name,
+          decoratorPath(name)})
+    {
+        auto find = interfaces.find(path);
+        if (find != interfaces.end())
+        {
+            server->remove_interface(find->second);
+            interfaces.erase(find);
+        }
+        mapperObjects.erase(path);
+    }
+}
+
+void DbusFixture::addConfig(const Config& config)
+{
+    auto iface = server->add_interface(config.path, config.interface);
+    for (const auto& [name, value] : config.properties)
+    {
+        std::visit(
+            [&iface, &name](const auto& v) {
+                iface->register_property(name, v);
+            },
+            value);
+    }
+    iface->initialize();
+    interfaces[config.path] = iface;
+}
+
+void DbusFixture::addDecorator(const std::string& name, bool functional)
+{
+    auto iface = server->add_interface(decoratorPath(name), decoratorInterface);
+    iface->register_property("functional", functional,
+                             sdbusplus::asio::PropertyPermission::readWrite);
+    iface->initialize();
+    interfaces[decoratorPath(name)] = iface;
+}
+
+void DbusFixture::attach(boost::asio::io_service& io)
+{
+    serviceConn = connect(io);
+    serviceConn->request_name("xyz.openbmc_project.ObjectMapper");
+    serviceConn->request_name(entityManagerName);
+    serviceConn->request_name("xyz.openbmc_project.Settings");
+    serviceConn->request_name("xyz.openbmc_project.FruDevice");
+    serviceConn->request_name(decoratorService);
+    server = std::make_unique<sdbusplus::asio::object_server>(serviceConn);
+    // Entity Manager serves its inventory through an ObjectManager, which
+    // also announces objects added and removed at runtime.
+    server->add_manager("/");
+
+    auto mapper = server->add_interface("/xyz/openbmc_project/object_mapper",
+                                        "xyz.openbmc_project.ObjectMapper");
+    mapper->register_method(
+        "GetSubTree", [this](const std::string& path, int32_t,
+                             const std::vector<std::string>& filter) {
+            GetSubTreeType subtree;
+            for (const auto& [objPath, entry] : mapperObjects)
+            {
+                if (objPath.compare(0, path.size(), path) != 0)
+                {
+                    continue;
+                }
+                std::vector<std::string> matched;
+                for (const auto& interface : entry.interfaces)
+                {
+                    if (filter.empty() ||
+                        std::find(filter.begin(), filter.end(), interface) !=
+                            filter.end())
+                    {
+                        matched.push_back(interface);
+                    }
+                }
+                if (!matched.empty())
+                {
+                    subtree.push_back(
+                        {objPath, {{entry.service, std::move(matched)}}});
+                }
+            }
+            return subtree;
+        });
+    mapper->initialize();
+    interfaces["/xyz/openbmc_project/object_mapper"] = mapper;
+
+    for (const auto& config : configs)
+    {
+        addConfig(config);
+    }
+    for (const auto& [name, functional] : decorators)
+    {
+        addDecorator(name, functional);
+    }
+
+    auto settings = server->add_interface(
+        settingsPath, "xyz.openbmc_project.Control.PowerSupplyRedundancy");
+    std::vector<uint8_t> rankOrder;
+    for (size_t index = 1; index <= std::max<size_t>(psuCount, 4); index++)
+    {
+        rankOrder.push_back(static_cast<uint8_t>(index));
+    }
+    constexpr auto rw = sdbusplus::asio::PropertyPermission::readWrite;
+    settings->register_property("PowerSupplyRedundancyEnabled",
+                                redundancyEnabled, rw);
+    settings->register_property("RotationEnabled", true, rw);
+    settings->register_property(
+        "RotationAlgorithm",
+        std::string("xyz.openbmc_project.Control.PowerSupplyRedundancy."
+                    "Algo.bmcSpecific"),
+        rw);
+    settings->register_property("RotationRankOrder", rankOrder, rw);
+    settings->register_property("PeriodOfRotation",
+                                static_cast<uint32_t>(7 * 86400), rw);
+    settings->initialize();
+    interfaces[settingsPath] = settings;
+
+    auto fru = server->add_interface("/xyz/openbmc_project/FruDevice",
+                                     "xyz.openbmc_project.FruDeviceManager");
+    fru->register_method("ReScanBus", [](uint8_t) {});
+    fru->initialize();
+    interfaces["/xyz/openbmc_project/FruDevice"] = fru;
+}
+
+// The service names are released with the connection.
+void DbusFixture::detach(void)
+{
+    interfaces.clear();
+    server.reset();
+    serviceConn.reset();
+}
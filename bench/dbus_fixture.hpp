@@ -0,0 +1,106 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <sys/types.h>
+
+#include <boost/asio/io_service.hpp>
+#include <map>
+#include <memory>
+#include <sdbusplus/asio/connection.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+#include <string>
+#include <vector>
+
+// Private dbus-daemon plus stand-ins for the services the daemon talks to:
+// object mapper, Entity Manager inventory, Settings, FruDevice and the PSU
+// OperationalStatus decorators. The stand-ins are served on the io_service of
+// the daemon under test, everything is built with BOOST_ASIO_DISABLE_THREADS
+// so the harness runs on a single thread as the daemon does.
+class DbusFixture
+{
+  public:
+    DbusFixture();
+    ~DbusFixture();
+    DbusFixture(const DbusFixture&) = delete;
+    DbusFixture& operator=(const DbusFixture&) = delete;
+
+    // Inventory setup, only valid before start().
+    void addPSU(const std::string& name, uint8_t bus, uint8_t address,
+                bool functional = true);
+    void addPresence(uint8_t bus, const std::vector<uint64_t>& addresses);
+    // Unrelated inventory objects the mapper has to filter out.
+    void addFiller(size_t count);
+    void setRedundantCount(uint8_t count);
+    void setRedundancyEnabled(bool enabled);
+    // RotationMode of the PURedundancy configuration, unset when empty.
+    void setRotationMode(const std::string& mode);
+
+    void start(void);
+
+    // Serve the stand-ins on io until detach(), the service names are owned
+    // once attach() returns. Only valid after start().
+    void attach(boost::asio::io_service& io);
+    void detach(void);
+
+    // Runtime changes, valid while attached. The resulting signals are
+    // delivered as the io_service runs.
+    void setFunctional(const std::string& name, bool functional);
+    void insertPSU(const std::string& name, uint8_t bus, uint8_t address);
+    void removePSU(const std::string& name);
+
+    // New connection to the private bus, driven by the caller's io_service.
+    std::shared_ptr<sdbusplus::asio::connection>
+        connect(boost::asio::io_service& io);
+
+  private:
+    struct MapperEntry
+    {
+        std::string service;
+        std::vector<std::string> interfaces;
+    };
+    struct Config
+    {
+        std::string path;
+        std::string interface;
+        std::map<std::string, std::variant<std::string, uint64_t, uint8_t,
+                                           std::vector<uint64_t>>>
+            properties;
+    };
+
+    static Config psuConfig(const std::string& name, uint8_t bus,
+                            uint8_t address);
+    void addConfig(const Config& config);
+    void addDecorator(const std::string& name, bool functional);
+
+    std::string tmpDir;
+    std::string address;
+    pid_t daemonPid = -1;
+
+    // Set while attached.
+    std::shared_ptr<sdbusplus::asio::connection> serviceConn;
+    std::unique_ptr<sdbusplus::asio::object_server> server;
+    std::map<std::string, std::shared_ptr<sdbusplus::asio::dbus_interface>>
+        interfaces;
+
+    std::vector<Config> configs;
+    std::map<std::string, bool> decorators;
+    std::map<std::string, MapperEntry> mapperObjects;
+    uint8_t redundantCount = 2;
+    bool redundancyEnabled = true;
+    std::string rotationMode;
+    size_t psuCount = 0;
+};
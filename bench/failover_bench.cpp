@@ -0,0 +1,270 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Failover latency regression harness. The daemon runs against a private
+// D-Bus and the simulated I2C backend, each scenario changes a decorator or
+// the inventory and is timed until every normal PSU holds the rank the daemon
+// assigned it in the simulated 0xD0 register. Reports p50/p99 per scenario
+// and PSU count as JSON, and exits non-zero when a scenario does not settle.
+//
+// Usage: psuredundancy-failover [iterations] [output file]
+
+#include "bench_util.hpp"
+#include "cold_redundancy.hpp"
+#include "dbus_fixture.hpp"
+#include "psu_registry.hpp"
+#include "sim_i2c_transport.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+
+static const std::array<size_t, 3> psuCounts = {2, 8, 32};
+static constexpr const int defaultIterations = 20;
+static constexpr const std::chrono::seconds settleTimeout(10);
+static constexpr const std::chrono::microseconds simLatency(300);
+
+// Every normal PSU holds the rank the daemon gave it, and the ranks are
+// exactly 1 to expected.
+static bool ranksSettled(const ColdRedundancy& cr,
+                         SimulatedI2CTransport& farm, size_t expected)
+{
+    if (!ColdRedundancyAccess::idle(cr))
+    {
+        return false;
+    }
+    std::vector<bool> seen(expected + 1, false);
+    size_t normal = 0;
+    for (const auto& psu : ColdRedundancyAccess::psus(cr))
+    {
+        if (psu.state != PSUState::normal)
+        {
+            continue;
+        }
+        normal++;
+        SimPSU* sim = farm.psu(psu.bus, psu.address);
+        if (sim == nullptr || psu.order == 0 || psu.order > expected ||
+            sim->rank() != psu.order || seen[psu.order])
+        {
+            return false;
+        }
+        seen[psu.order] = true;
+    }
+    return normal == expected;
+}
+
+static const PowerSupply* psuWithRank(const ColdRedundancy& cr, uint8_t rank)
+{
+    for (const auto& psu : ColdRedundancyAccess::psus(cr))
+    {
+        if (psu.state == PSUState::normal && psu.order == rank)
+        {
+            return &psu;
+        }
+    }
+    return nullptr;
+}
+
+// Milliseconds from inject() until done() holds, nullopt on timeout.
+template <typename Inject, typename Done>
+static std::optional<double> measure(DaemonUnderTest& daemon, Inject&& inject,
+                                     Done&& done)
+{
+    auto start = std::chrono::steady_clock::now();
+    inject();
+    if (!runUntil(daemon.io, std::forward<Done>(done), settleTimeout))
+    {
+        return std::nullopt;
+    }
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+static double percentile(std::vector<double> samples, double fraction)
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t index = static_cast<size_t>(fraction * (samples.size() - 1) + 0.5);
+    return samples[std::min(index, samples.size() - 1)];
+}
+
+struct Scenario
+{
+    const char* name;
+    std::vector<double> samples;
+    size_t timeouts = 0;
+
+    void add(std::optional<double> sample)
+    {
+        if (sample)
+        {
+            samples.push_back(*sample);
+        }
+        else
+        {
+            timeouts++;
+        }
+    }
+};
+
+// Returns false if any scenario failed to settle.
+static bool runFarm(size_t count, int iterations, nlohmann::json& results)
+{
+    DbusFixture fixture;
+    SimulatedI2CTransport& farm = installFarm(fixture, count, simLatency);
+    fixture.start();
+
+    DaemonUnderTest daemon(fixture);
+    ColdRedundancy& cr = daemon.cr;
+    if (!daemon.waitForPSUs(count))
+    {
+        std::cerr << count << " PSUs were not discovered\n";
+        return false;
+    }
+    daemon.run(ColdRedundancyAccess::configCR(cr, true));
+    if (!runUntil(daemon.io, [&]() { return ranksSettled(cr, farm, count); },
+                  settleTimeout))
+    {
+        std::cerr << "Initial ranks did not settle with " << count
+                  << " PSUs\n";
+        return false;
+    }
+
+    Scenario loss{"loss"};
+    Scenario restore{"restore"};
+    Scenario remove{"remove"};
+    Scenario insert{"insert"};
+    for (int i = 0; i < iterations; i++)
+    {
+        // The always on PSU loses AC, which also clears its rank.
+        const PowerSupply* active = psuWithRank(cr, 1);
+        if (active == nullptr)
+        {
+            std::cerr << "No PSU holds rank 1\n";
+            return false;
+        }
+        std::string name = active->name;
+        uint8_t bus = active->bus;
+        uint8_t address = active->address;
+        auto lost = [&]() {
+            return psuState(cr, name) == PSUState::acLost &&
+                   ranksSettled(cr, farm, count - 1);
+        };
+        loss.add(measure(
+            daemon,
+            [&]() {
+                farm.psu(bus, address)->registers[pmbusCmdCRSupport] = 0;
+                fixture.setFunctional(name, false);
+            },
+            lost));
+        restore.add(measure(
+            daemon, [&]() { fixture.setFunctional(name, true); },
+            [&]() { return ranksSettled(cr, farm, count); }));
+
+        // The last PSU is pulled, then plugged back in.
+        const PowerSupply* last = nullptr;
+        for (const auto& psu : ColdRedundancyAccess::psus(cr))
+        {
+            last = &psu;
+        }
+        name = last->name;
+        bus = last->bus;
+        address = last->address;
+        remove.add(measure(
+            daemon,
+            [&]() {
+                farm.removePSU(bus, address);
+                fixture.removePSU(name);
+            },
+            [&]() {
+                return ColdRedundancyAccess::psuCount(cr) == count - 1 &&
+                       ranksSettled(cr, farm, count - 1);
+            }));
+        insert.add(measure(
+            daemon,
+            [&]() {
+                farm.addPSU(bus, address);
+                fixture.insertPSU(name, bus, address);
+            },
+            [&]() {
+                return ColdRedundancyAccess::psuCount(cr) == count &&
+                       ranksSettled(cr, farm, count);
+            }));
+    }
+
+    bool settled = true;
+    for (const Scenario* scenario : {&loss, &restore, &remove, &insert})
+    {
+        nlohmann::json entry;
+        entry["scenario"] = scenario->name;
+        entry["psus"] = count;
+        entry["samples"] = scenario->samples.size();
+        entry["timeouts"] = scenario->timeouts;
+        entry["p50_ms"] = percentile(scenario->samples, 0.50);
+        entry["p99_ms"] = percentile(scenario->samples, 0.99);
+        results.push_back(entry);
+        settled = settled && scenario->timeouts == 0;
+    }
+    return settled;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = defaultIterations;
+    if (argc > 1)
+    {
+        iterations = std::max(1, std::stoi(argv[1]));
+    }
+
+    nlohmann::json results;
+    results["iterations"] = iterations;
+    results["sim_latency_us"] = simLatency.count();
+    // Restore and insert go through the coalesced reconciliation pass, the
+    // warm hold before their rank writes is disabled.
+    results["warm_hold_ms"] = 0;
+    results["failover"] = nlohmann::json::array();
+    bool settled = true;
+    try
+    {
+        for (size_t count : psuCounts)
+        {
+            settled =
+                runFarm(count, iterations, results["failover"]) && settled;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        settled = false;
+    }
+
+    if (argc > 2)
+    {
+        std::ofstream(argv[2]) << results.dump(2) << "\n";
+    }
+    else
+    {
+        std::cout << results.dump(2) << "\n";
+    }
+    return settled ? 0 : 1;
+}
@@ -0,0 +1,410 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// PSU lifetime simulation. The daemon runs against a private D-Bus and the
+// simulated I2C backend on virtual time, so months of rotations, AC losses
+// and rotation period changes play out in seconds. The event sequence comes
+// from a fixed seed and is replayed for each rotation mode. Reports the share
+// of time each PSU spent active, as cold standby, warm and without AC, the
+// fairness of the active time and the rank transitions as JSON.
+//
+// Fails when a mode did not settle, never handed the active role over or
+// spread the active time below minFairness, or when Minimal did not write
+// fewer ranks than AllWarm.
+//
+// Usage: psuredundancy-lifetime [days] [output file]
+
+#include "bench_util.hpp"
+#include "cold_redundancy.hpp"
+#include "dbus_fixture.hpp"
+#include "psu_clock.hpp"
+#include "psu_registry.hpp"
+#include "sim_i2c_transport.hpp"
+
+#include <systemd/sd-bus.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sdbusplus/bus/match.hpp>
+#include <string>
+
+static constexpr const size_t psuCount = 4;
+static constexpr const int defaultDays = 182;
+static constexpr const uint32_t seed = 20190601;
+static constexpr const std::chrono::seconds settleTimeout(10);
+// Jain's index of the active shares every mode has to reach, 1 is an even
+// split and 1 / psuCount all of it on one PSU.
+static constexpr const double minFairness = 0.75;
+// Farm wide mean time between AC losses and the outage length range.
+static constexpr const std::chrono::hours meanTimeToLoss(21 * 24);
+static constexpr const std::chrono::hours minOutage(2);
+static constexpr const std::chrono::hours maxOutage(48);
+// The rotation period alternates between these every configPeriod.
+static constexpr const std::chrono::hours configPeriod(30 * 24);
+static const std::array<uint32_t, 2> rotationPeriods = {7 * oneDay,
+                                                        3 * oneDay};
+static const std::array<const char*, 2> rotationModes = {"AllWarm",
+                                                         "Minimal"};
+static const constexpr char* daemonPath =
+    "/xyz/openbmc_project/control/power_supply_redundancy";
+
+// Runs what is due at the current virtual time: ready handlers, replies
+// still on the wire and the signals the daemon sends to itself. A Ping to the
+// bus is routed behind everything the daemon sent before it, so once the
+// reply is in those signals have been delivered too. Settled once a round
+// finds nothing to run, no call pending and no signal received.
+class Settler
+{
+  public:
+    explicit Settler(DaemonUnderTest& daemon) :
+        daemon(daemon),
+        signalMatch(static_cast<sdbusplus::bus::bus&>(*daemon.conn),
+                    "type='signal'",
+                    [this](sdbusplus::message::message&) { signals++; })
+    {
+    }
+
+    bool settle(void)
+    {
+        auto deadline = std::chrono::steady_clock::now() + settleTimeout;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            size_t handled = poll();
+            uint64_t timeout = 0;
+            sd_bus_get_timeout(daemon.conn->get(), &timeout);
+            if (timeout != UINT64_MAX)
+            {
+                daemon.io.run_one_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            size_t seen = signals;
+            bool pong = false;
+            daemon.conn->async_method_call(
+                [&pong](const boost::system::error_code&) { pong = true; },
+                "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                "org.freedesktop.DBus.Peer", "Ping");
+            if (!runUntil(
+                    daemon.io, [&pong]() { return pong; }, settleTimeout))
+            {
+                return false;
+            }
+            handled += poll();
+            if (handled == 0 && seen == signals)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+  private:
+    size_t poll(void)
+    {
+        size_t handled = daemon.io.poll();
+        if (daemon.io.stopped())
+        {
+            daemon.io.restart();
+        }
+        return handled;
+    }
+
+    DaemonUnderTest& daemon;
+    size_t signals = 0;
+    sdbusplus::bus::match::match signalMatch;
+};
+
+// Time one PSU spent in each role, from the rank its 0xD0 register held.
+struct Roles
+{
+    PSUClock::duration active{};
+    PSUClock::duration standby{};
+    PSUClock::duration warm{};
+    PSUClock::duration lost{};
+};
+
+static double share(PSUClock::duration part, PSUClock::duration total)
+{
+    return std::chrono::duration<double>(part).count() /
+           std::chrono::duration<double>(total).count();
+}
+
+// Jain's index, 1 when every PSU was active for the same time and 1/n when
+// one PSU carried the load alone.
+static double fairness(const std::vector<double>& values)
+{
+    double sum = 0.0;
+    double squares = 0.0;
+    for (double value : values)
+    {
+        sum += value;
+        squares += value * value;
+    }
+    if (squares == 0.0)
+    {
+        return 0.0;
+    }
+    return sum * sum / (values.size() * squares);
+}
+
+static bool runLifetime(int days, const char* mode, nlohmann::json& results)
+{
+    DbusFixture fixture;
+    fixture.setRotationMode(mode);
+    SimulatedI2CTransport& farm = installFarm(fixture, psuCount);
+    fixture.start();
+
+    // Every timer the daemon arms from here on runs on virtual time.
+    PSUClock::useVirtualTime();
+    DaemonUnderTest daemon(fixture);
+    ColdRedundancy& cr = daemon.cr;
+    if (!daemon.waitForPSUs(psuCount))
+    {
+        std::cerr << psuCount << " PSUs were not discovered\n";
+        return false;
+    }
+    ColdRedundancyAccess::setWarmHold(cr, std::chrono::milliseconds(5000));
+    Settler settler(daemon);
+
+    std::mt19937 random(seed);
+    std::exponential_distribution<double> timeToLoss(
+        1.0 / std::chrono::duration<double>(meanTimeToLoss).count());
+    std::uniform_int_distribution<int64_t> outage(
+        std::chrono::seconds(minOutage).count(),
+        std::chrono::seconds(maxOutage).count());
+    auto nextLoss = [&](PSUClock::time_point from) {
+        return from + std::chrono::duration_cast<PSUClock::duration>(
+                          std::chrono::duration<double>(timeToLoss(random)));
+    };
+
+    auto start = PSUClock::now();
+    auto end = start + std::chrono::hours(24 * days);
+    auto now = start;
+    auto lossAt = nextLoss(now);
+    auto restoreAt = PSUClock::time_point::max();
+    auto configAt = now + configPeriod;
+    std::string lostPSU;
+    size_t losses = 0;
+    size_t periodChanges = 0;
+    size_t handovers = 0;
+    std::string activePSU;
+    std::map<std::string, Roles> roles;
+
+    while (now < end)
+    {
+        if (!settler.settle())
+        {
+            std::cerr << "Daemon did not settle at "
+                      << std::chrono::duration_cast<std::chrono::seconds>(
+                             now - start)
+                             .count()
+                      << "s\n";
+            return false;
+        }
+
+        auto target = std::min({end, lossAt, restoreAt, configAt});
+        if (auto expiry = PSUClock::nextExpiry())
+        {
+            target = std::min(target, *expiry);
+        }
+        for (const auto& psu : ColdRedundancyAccess::psus(cr))
+        {
+            Roles& role = roles[psu.name];
+            SimPSU* simPSU = farm.psu(psu.bus, psu.address);
+            if (psu.state != PSUState::normal || simPSU == nullptr)
+            {
+                role.lost += target - now;
+            }
+            else if (simPSU->rank() == 1)
+            {
+                role.active += target - now;
+                if (activePSU != psu.name)
+                {
+                    handovers += activePSU.empty() ? 0 : 1;
+                    activePSU = psu.name;
+                }
+            }
+            else if (simPSU->rank() == 0)
+            {
+                role.warm += target - now;
+            }
+            else
+            {
+                role.standby += target - now;
+            }
+        }
+        PSUClock::advanceTo(target);
+        now = target;
+
+        if (now == restoreAt)
+        {
+            fixture.setFunctional(lostPSU, true);
+            if (!runUntil(daemon.io, [&]() {
+                    return psuState(cr, lostPSU) == PSUState::normal;
+                }))
+            {
+                std::cerr << lostPSU << " was not restored\n";
+                return false;
+            }
+            restoreAt = PSUClock::time_point::max();
+            lossAt = nextLoss(now);
+        }
+        else if (now == lossAt)
+        {
+            // Pick one of the working PSUs, losing AC also clears its rank.
+            std::vector<const PowerSupply*> candidates;
+            for (const auto& psu : ColdRedundancyAccess::psus(cr))
+            {
+                if (psu.state == PSUState::normal)
+                {
+                    candidates.push_back(&psu);
+                }
+            }
+            std::uniform_int_distribution<size_t> pick(0,
+                                                       candidates.size() - 1);
+            const PowerSupply* victim = candidates[pick(random)];
+            lostPSU = victim->name;
+            farm.psu(victim->bus, victim->address)
+                ->registers[pmbusCmdCRSupport] = 0;
+            fixture.setFunctional(lostPSU, false);
+            if (!runUntil(daemon.io, [&]() {
+                    return psuState(cr, lostPSU) == PSUState::acLost;
+                }))
+            {
+                std::cerr << lostPSU << " did not lose AC\n";
+                return false;
+            }
+            losses++;
+            restoreAt = now + std::chrono::seconds(outage(random));
+            lossAt = PSUClock::time_point::max();
+        }
+        if (now == configAt)
+        {
+            bool done = false;
+            std::variant<uint32_t> period =
+                rotationPeriods[++periodChanges % rotationPeriods.size()];
+            daemon.conn->async_method_call(
+                [&done](const boost::system::error_code& ec) {
+                    if (ec)
+                    {
+                        std::cerr << "Failed to set PeriodOfRotation\n";
+                    }
+                    done = true;
+                },
+                "xyz.openbmc_project.PSURedundancy", daemonPath,
+                "org.freedesktop.DBus.Properties", "Set",
+                redundancyInterface, "PeriodOfRotation", period);
+            if (!runUntil(daemon.io, [&done]() { return done; }))
+            {
+                return false;
+            }
+            configAt = now + configPeriod;
+        }
+    }
+
+    auto total = end - start;
+    std::vector<double> activeShares;
+    uint64_t rankWrites = 0;
+    results["psu"] = nlohmann::json::array();
+    for (const auto& psu : ColdRedundancyAccess::psus(cr))
+    {
+        const Roles& role = roles[psu.name];
+        SimPSU* simPSU = farm.psu(psu.bus, psu.address);
+        uint64_t writes = simPSU != nullptr ? simPSU->rankChanges : 0;
+        nlohmann::json entry;
+        entry["name"] = psu.name;
+        entry["active_share"] = share(role.active, total);
+        entry["standby_share"] = share(role.standby, total);
+        entry["warm_share"] = share(role.warm, total);
+        entry["lost_share"] = share(role.lost, total);
+        entry["rank_changes"] = writes;
+        results["psu"].push_back(entry);
+        activeShares.push_back(share(role.active, total));
+        rankWrites += writes;
+    }
+    results["active_fairness"] = fairness(activeShares);
+    results["active_handovers"] = handovers;
+    results["rank_changes"] = rankWrites;
+    results["ac_losses"] = losses;
+    results["period_changes"] = periodChanges;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int days = defaultDays;
+    if (argc > 1)
+    {
+        days = std::max(1, std::stoi(argv[1]));
+    }
+
+    nlohmann::json results;
+    results["days"] = days;
+    results["psus"] = psuCount;
+    results["seed"] = seed;
+    results["runs"] = nlohmann::json::array();
+    bool ok = true;
+    std::map<std::string, uint64_t> rankChanges;
+    for (const char* mode : rotationModes)
+    {
+        nlohmann::json run;
+        run["rotation_mode"] = mode;
+        bool settled = false;
+        run["real_seconds"] =
+            timeSeconds([&]() { settled = runLifetime(days, mode, run); });
+        results["runs"].push_back(run);
+        if (!settled)
+        {
+            ok = false;
+            continue;
+        }
+        if (run["active_handovers"].get<size_t>() == 0)
+        {
+            std::cerr << mode << ": the active PSU never changed\n";
+            ok = false;
+        }
+        if (run["active_fairness"].get<double>() < minFairness)
+        {
+            std::cerr << mode << ": active fairness "
+                      << run["active_fairness"].get<double>() << " below "
+                      << minFairness << "\n";
+            ok = false;
+        }
+        rankChanges[mode] = run["rank_changes"].get<uint64_t>();
+    }
+    if (rankChanges.size() == rotationModes.size() &&
+        rankChanges["Minimal"] >= rankChanges["AllWarm"])
+    {
+        std::cerr << "Minimal wrote " << rankChanges["Minimal"]
+                  << " ranks, AllWarm " << rankChanges["AllWarm"] << "\n";
+        ok = false;
+    }
+
+    if (argc > 2)
+    {
+        std::ofstream(argv[2]) << results.dump(2) << "\n";
+    }
+    else
+    {
+        std::cout << results.dump(2) << "\n";
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,344 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Benchmarks for the PMBus and cold redundancy hot paths, run against the
+// simulated I2C backend and a private D-Bus with stand-in services. Results
+// are printed as JSON, or written to the file given as first argument.
+
+#include "bench_util.hpp"
+#include "cold_redundancy.hpp"
+#include "dbus_fixture.hpp"
+#include "pmbus.hpp"
+#include "psu_registry.hpp"
+#include "sim_i2c_transport.hpp"
+
+#include <systemd/sd-bus.h>
+
+#include <boost/asio/co_spawn.hpp>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+
+static const std::array<size_t, 6> psuCounts = {2, 4, 8, 16, 32, 64};
+static constexpr const int transitionIterations = 20;
+static constexpr const int pmbusIterations = 2000;
+static constexpr const int signalIterations = 200000;
+// Per transaction cost of the simulated bus, roughly a 100kHz SMBus byte
+// write or read.
+static constexpr const std::chrono::microseconds simLatency(300);
+
+// Failures throw, the benchmark exits non-zero instead of printing timings
+// of work that did not finish.
+static void discover(DaemonUnderTest& daemon, size_t count)
+{
+    if (!daemon.waitForPSUs(count))
+    {
+        throw std::runtime_error(std::to_string(count) +
+                                 " PSUs were not discovered");
+    }
+}
+
+static nlohmann::json benchPmbus(void)
+{
+    boost::asio::io_service io;
+    auto sim = std::make_unique<SimulatedI2CTransport>();
+    SimulatedI2CTransport& farm = *sim;
+    farm.addPSU(0, 0x58);
+    farm.setLatency(simLatency);
+    setI2CTransport(std::move(sim));
+    Pmbus pmbus(io);
+
+    auto writes = [&pmbus]() -> boost::asio::awaitable<void> {
+        for (int i = 0; i < pmbusIterations; i++)
+        {
+            co_await pmbus.write(0, 0x58, pmbusCmdCRSupport,
+                                 static_cast<uint8_t>(i % 4));
+        }
+    };
+    auto reads = [&pmbus]() -> boost::asio::awaitable<void> {
+        for (int i = 0; i < pmbusIterations; i++)
+        {
+            co_await pmbus.read(0, 0x58, pmbusCmdCRSupport);
+        }
+    };
+
+    nlohmann::json result;
+    double seconds = timeSeconds([&]() { runCoroutine(io, writes()); });
+    result["write_ops_per_sec"] = pmbusIterations / seconds;
+    farm.setRdwrSupported(false);
+    seconds = timeSeconds([&]() { runCoroutine(io, writes()); });
+    result["write_ops_per_sec_split"] = pmbusIterations / seconds;
+    seconds = timeSeconds([&]() { runCoroutine(io, reads()); });
+    result["read_ops_per_sec"] = pmbusIterations / seconds;
+    result["sim_latency_us"] = simLatency.count();
+    return result;
+}
+
+// configCR(true) and rotateCR latency, with the warm hold disabled so the
+// figures are the PMBus and scheduling cost of a transition.
+static void benchTransitions(nlohmann::json& configResults,
+                             nlohmann::json& rotateResults)
+{
+    for (size_t count : psuCounts)
+    {
+        DbusFixture fixture;
+        installFarm(fixture, count, simLatency);
+        fixture.start();
+
+        DaemonUnderTest daemon(fixture);
+        discover(daemon, count);
+
+        double configSeconds = timeSeconds([&]() {
+            for (int i = 0; i < transitionIterations; i++)
+            {
+                daemon.run(ColdRedundancyAccess::configCR(daemon.cr, true));
+            }
+        });
+        double rotateSeconds = timeSeconds([&]() {
+            for (int i = 0; i < transitionIterations; i++)
+            {
+                daemon.run(ColdRedundancyAccess::rotateCR(daemon.cr));
+            }
+        });
+
+        nlohmann::json config;
+        config["psus"] = count;
+        config["ms"] = configSeconds * 1000.0 / transitionIterations;
+        configResults.push_back(config);
+        nlohmann::json rotate;
+        rotate["psus"] = count;
+        rotate["ms"] = rotateSeconds * 1000.0 / transitionIterations;
+        rotateResults.push_back(rotate);
+    }
+}
+
+// One presence scan over all slots, eight per presence bus.
+static nlohmann::json benchKeepAlive(void)
+{
+    static const std::array<size_t, 4> busCounts = {1, 2, 4, 8};
+    constexpr size_t slotsPerBus = 8;
+    constexpr int iterations = 50;
+    nlohmann::json results = nlohmann::json::array();
+
+    for (size_t buses : busCounts)
+    {
+        DbusFixture fixture;
+        auto sim = std::make_unique<SimulatedI2CTransport>();
+        sim->setLatency(simLatency);
+        std::vector<std::vector<uint8_t>> presence(buses);
+        for (size_t bus = 0; bus < buses; bus++)
+        {
+            for (size_t index = 0; index < slotsPerBus; index++)
+            {
+                uint8_t address = static_cast<uint8_t>(0x50 + index);
+                presence[bus].push_back(address);
+                // Half of the slots are empty, those NACK.
+                if (index % 2 == 0)
+                {
+                    sim->addPSU(bus, address);
+                }
+            }
+        }
+        setI2CTransport(std::move(sim));
+        fixture.start();
+
+        DaemonUnderTest daemon(fixture);
+        for (size_t bus = 0; bus < buses; bus++)
+        {
+            ColdRedundancyAccess::addPresence(
+                daemon.cr, static_cast<uint8_t>(bus), presence[bus]);
+        }
+        // The first scan finds the PSUs and asks FruDevice for a rescan.
+        daemon.run(ColdRedundancyAccess::keepAlive(daemon.cr));
+
+        double seconds = timeSeconds([&]() {
+            for (int i = 0; i < iterations; i++)
+            {
+                daemon.run(ColdRedundancyAccess::keepAlive(daemon.cr));
+            }
+        });
+        nlohmann::json entry;
+        entry["buses"] = buses;
+        entry["addresses"] = buses * slotsPerBus;
+        entry["us"] = seconds * 1e6 / iterations;
+        results.push_back(entry);
+    }
+    return results;
+}
+
+static nlohmann::json benchDiscovery(void)
+{
+    constexpr size_t fillerPerPSU = 8;
+    nlohmann::json results = nlohmann::json::array();
+
+    for (size_t count : psuCounts)
+    {
+        DbusFixture fixture;
+        installFarm(fixture, count);
+        fixture.addFiller(count * fillerPerPSU);
+        fixture.start();
+
+        // The constructor posts the initial createPSU, the mode is switched
+        // before the io_service first runs. Serving the stand-ins is not
+        // part of the timing.
+        double managedObjects = 0;
+        {
+            DaemonUnderTest daemon(fixture);
+            managedObjects = timeSeconds([&]() { discover(daemon, count); });
+        }
+        double subTree = 0;
+        {
+            DaemonUnderTest daemon(fixture);
+            ColdRedundancyAccess::useSubTreeDiscovery(daemon.cr);
+            subTree = timeSeconds([&]() { discover(daemon, count); });
+        }
+        nlohmann::json entry;
+        entry["psus"] = count;
+        entry["inventory_objects"] = count * (fillerPerPSU + 1) + 1;
+        entry["managed_objects_ms"] = managedObjects * 1000.0;
+        entry["subtree_ms"] = subTree * 1000.0;
+        results.push_back(entry);
+    }
+    return results;
+}
+
+// Per signal cost of decoding an OperationalStatus PropertiesChanged and
+// finding its PSU among 64: the substr and sdbusplus read with a linear name
+// scan it replaced, against the string_view decoder, the raw message reader
+// and the registry name index.
+static nlohmann::json benchStateSignal(void)
+{
+    constexpr size_t psus = 64;
+    DbusFixture fixture;
+    boost::asio::io_service io;
+    auto conn = fixture.connect(io);
+
+    sd_bus_message* raw = nullptr;
+    if (sd_bus_message_new_signal(
+            conn->get(), &raw,
+            "/xyz/openbmc_project/State/Decorator/PSU48_OperationalStatus",
+            "org.freedesktop.DBus.Properties", "PropertiesChanged") < 0)
+    {
+        throw std::runtime_error("failed to create signal");
+    }
+    sd_bus_message_append(raw, "s", psuEventInterface[0]);
+    sd_bus_message_open_container(raw, SD_BUS_TYPE_ARRAY, "{sv}");
+    sd_bus_message_append(raw, "{sv}", "functional", "b", 0);
+    sd_bus_message_close_container(raw);
+    sd_bus_message_append(raw, "as", 0);
+    sd_bus_message_seal(raw, 1, 0);
+    sdbusplus::message::message message(raw);
+    sd_bus_message_unref(raw);
+
+    std::vector<std::string> names;
+    PSURegistry registry;
+    for (size_t index = 0; index < psus; index++)
+    {
+        std::string name = "PSU" + std::to_string(index + 1);
+        auto [bus, address] = psuLocation(index);
+        names.push_back(name);
+        registry.insert(PowerSupply(name, bus, address, 0));
+    }
+
+    size_t lost = 0;
+    double legacy = timeSeconds([&]() {
+        for (int i = 0; i < signalIterations; i++)
+        {
+            sd_bus_message_rewind(message.get(), 1);
+            std::string path = message.get_path();
+            std::string statePSUName =
+                path.substr(path.find_last_of("/\\") + 1);
+            std::string psuName =
+                statePSUName.substr(0, statePSUName.find("_"));
+            std::string objectName;
+            boost::container::flat_map<std::string, std::variant<bool>>
+                values;
+            message.read(objectName, values);
+            for (const auto& name : names)
+            {
+                if (name != psuName)
+                {
+                    continue;
+                }
+                auto find = values.find("functional");
+                if (find != values.end() && !std::get<bool>(find->second))
+                {
+                    lost++;
+                }
+            }
+        }
+    });
+    double decoder = timeSeconds([&]() {
+        for (int i = 0; i < signalIterations; i++)
+        {
+            sd_bus_message_rewind(message.get(), 1);
+            auto psuName = psuNameFromStatePath(message.get_path());
+            if (!psuName || !registry.findByName(*psuName))
+            {
+                continue;
+            }
+            std::optional<bool> functional =
+                readFunctionalChange(message.get());
+            if (functional && !*functional)
+            {
+                lost++;
+            }
+        }
+    });
+    if (lost != 2 * signalIterations)
+    {
+        throw std::runtime_error("state signal decoders disagree");
+    }
+
+    nlohmann::json result;
+    result["psus"] = psus;
+    result["legacy_ns_per_signal"] = legacy * 1e9 / signalIterations;
+    result["ns_per_signal"] = decoder * 1e9 / signalIterations;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    nlohmann::json results;
+    try
+    {
+        results["pmbus"] = benchPmbus();
+        nlohmann::json configResults = nlohmann::json::array();
+        nlohmann::json rotateResults = nlohmann::json::array();
+        benchTransitions(configResults, rotateResults);
+        results["configCR"] = configResults;
+        results["rotateCR"] = rotateResults;
+        results["keepAlive"] = benchKeepAlive();
+        results["discovery"] = benchDiscovery();
+        results["stateSignal"] = benchStateSignal();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (argc > 1)
+    {
+        std::ofstream(argv[1]) << results.dump(2) << "\n";
+    }
+    else
+    {
+        std::cout << results.dump(2) << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <array>
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <psu_clock.hpp>
+
+// Collects dirty flags raised by signals and runs one reconciliation pass for
+// all of them. Each flag has its own window: the pass runs once the shortest
+// window of the pending flags has passed since the first of them was raised,
+// so a steady stream of signals cannot postpone it forever.
+class Coalescer
+{
+  public:
+    using Flags = uint32_t;
+    static constexpr size_t maxFlags = 8;
+
+    Coalescer(boost::asio::io_service& io,
+              std::function<void(Flags)>&& reconcile);
+
+    // window applies to every bit set in flags.
+    void setWindow(Flags flags, std::chrono::milliseconds window);
+    void mark(Flags flags);
+    // Run the pending pass now.
+    void flush(void);
+
+    Flags pending(void) const
+    {
+        return dirty;
+    }
+
+  private:
+    void arm(PSUClock::time_point when);
+
+    PSUTimer timer;
+    std::function<void(Flags)> reconcile;
+    std::array<std::chrono::milliseconds, maxFlags> windows = {};
+    Flags dirty = 0;
+    std::optional<PSUClock::time_point> deadline;
+};
@@ -14,9 +14,23 @@
 // limitations under the License.
 */
 
+#pragma once
+#include <sys/inotify.h>
+
+#include <array>
+#include <boost/asio/awaitable.hpp>
 #include <boost/asio/io_service.hpp>
-#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <chrono>
+#include <coalescer.hpp>
+#include <optional>
+#include <pmbus.hpp>
+#include <psu_clock.hpp>
+#include <psu_registry.hpp>
 #include <sdbusplus/asio/object_server.hpp>
+#include <snapshot.hpp>
 #include <utility.hpp>
 #include <xyz/openbmc_project/Control/PowerSupplyRedundancy/server.hpp>
 
@@ -24,13 +38,31 @@
 #define psuNumber pSUNumber
 #endif
 
+// Local copy of the last configuration, empty to disable it.
+#ifndef PSU_SNAPSHOT_PATH
+#define PSU_SNAPSHOT_PATH "/var/lib/psu-manager/cold_redundancy.snapshot"
+#endif
+
 const constexpr char* psuInterface =
     "/xyz/openbmc_project/inventory/system/powersupply/";
+// Rotation schedule, kept off the redundancy interface so that its changes
+// are not taken for configuration changes.
+const constexpr char* rotationInterfaceName =
+    "xyz.openbmc_project.PSURedundancy.Rotation";
 const constexpr int oneDay = 86400;
 const constexpr int oneMonth = 30 * oneDay;
 const constexpr int minRotationPeriod = oneDay;
 const constexpr int maxRotationPeriod = 6 * oneMonth;
 constexpr const uint8_t pmbusCmdCRSupport = 0xd0;
+// One rank write to the cold redundancy PMBus command of a PSU.
+struct PmbusWrite
+{
+    uint8_t bus;
+    uint8_t address;
+    uint8_t value;
+    std::chrono::milliseconds settleDelay;
+};
+
 using Association = std::tuple<std::string, std::string, std::string>;
 using crConfigVariant =
     std::variant<bool, uint8_t, uint32_t, std::vector<uint8_t>, std::string>;
@@ -38,6 +70,9 @@ using crConfigVariant =
 class ColdRedundancy
     : sdbusplus::xyz::openbmc_project::Control::server::PowerSupplyRedundancy
 {
+    // Benchmark and test harnesses drive the transitions directly.
+    friend struct ColdRedundancyAccess;
+
   public:
     ColdRedundancy(
         boost::asio::io_service& io,
@@ -47,6 +82,8 @@ class ColdRedundancy
     ~ColdRedundancy()
     {
         objServer.remove_interface(association);
+        objServer.remove_interface(metrics);
+        objServer.remove_interface(rotationSchedule);
     };
 
     uint8_t psuNumber() const override;
@@ -61,50 +98,172 @@ class ColdRedundancy
     uint8_t psOrder;
     uint8_t numberOfPSU = 0;
     std::vector<uint8_t> settingsOrder = {};
+    std::optional<uint8_t> previousWorkable;
+    // Time all PSUs are held warm before new ranks are written. A minimal
+    // rotation holds only the incoming PSU active for it before the
+    // outgoing one goes cold.
+    std::chrono::milliseconds warmRedundantHold{5000};
+    // How a rotation moves the ranks: every PSU warm and then every rank
+    // rewritten, or only the active role handed from one PSU to the next.
+    enum class RotationMode
+    {
+        allWarm,
+        minimal
+    };
+    RotationMode rotationMode = RotationMode::allWarm;
+
+    // How the PSU configuration is read from Entity Manager, GetSubTree is
+    // also the fallback when GetManagedObjects fails.
+    enum class DiscoveryMode
+    {
+        managedObjects,
+        subTree
+    };
+    DiscoveryMode discoveryMode = DiscoveryMode::managedObjects;
+
+    PSURegistry powerSupplies;
+    // One PSUPresence record: the PSU slots on a bus and whether each of
+    // them answered the last ping.
+    struct PresenceBus
+    {
+        std::string configPath;
+        std::vector<uint8_t> addresses;
+        std::vector<bool> present;
+        PresenceProbe probe = PresenceProbe::readByte;
+        // Command read by the register probe, PMBUS_REVISION by default.
+        uint8_t probeRegister = 0x98;
+        // Optional file touched when the population may have changed.
+        std::string hintFile;
+        int hintWatch = -1;
+    };
+    boost::container::flat_map<uint8_t, PresenceBus> presenceBuses;
+    bool scanInProgress = false;
+    bool presenceChanged = false;
+    // Presence polling backs off from the fast to the slow interval while
+    // nothing changes.
+    static constexpr std::chrono::milliseconds presenceFastInterval{2000};
+    static constexpr std::chrono::milliseconds presenceSlowInterval{32000};
+    std::chrono::milliseconds presenceInterval = presenceFastInterval;
+    PSUClock::time_point lastPresenceScan;
+    std::optional<PSUClock::time_point> presenceHintTime;
+    std::optional<boost::asio::posix::stream_descriptor> hintWatcher;
+    alignas(inotify_event) std::array<char, 1024> hintEvents;
+    bool rescanInProgress = false;
+    boost::container::flat_set<uint8_t> rescanQueue;
+
+    // Work raised by signals, done once per coalescing window in reconcile().
+    enum Dirty : Coalescer::Flags
+    {
+        dirtyInventory = 1 << 0,
+        dirtyState = 1 << 1,
+        dirtyConfig = 1 << 2,
+        dirtyRankOrder = 1 << 3,
+        // A PSU was inserted or restored after discovery and needs a rank.
+        dirtyRanks = 1 << 4
+    };
 
     void startRotateCR(void);
+    std::chrono::seconds rotationPeriod(void);
+    void alignRotation(std::chrono::system_clock::time_point now);
+    void publishNextRotation(void);
     void startCRCheck(void);
-    void rotateCR(void);
-    void configCR(bool reConfig);
-    void checkCR(void);
+    boost::asio::awaitable<void> rotateCR(void);
+    boost::asio::awaitable<void> rotateMinimal(void);
+    boost::asio::awaitable<void> configCR(bool reConfig);
+    boost::asio::awaitable<void> checkCR(void);
     void reRanking(void);
-    void putWarmRedundant(void);
-    void keepAliveCheck(void);
-    void writePmbus(uint8_t bus, uint8_t slaveAddr, uint8_t value);
-    void readPmbus(uint8_t bus, uint8_t slaveAddr, int& value);
-    void checkRedundancyEvent(void);
+    bool applyRankOrder(void);
+    boost::asio::awaitable<void> putWarmRedundant(void);
+    boost::asio::awaitable<bool> waitWarmRedundant(void);
+    boost::asio::awaitable<void> writeRanks(std::vector<PmbusWrite> writes);
+    boost::asio::awaitable<void>
+        writeBusRanks(std::vector<PmbusWrite> writes);
+    boost::asio::awaitable<void>
+        runConcurrently(std::vector<boost::asio::awaitable<void>> tasks);
+    void keepAliveCheck(std::chrono::milliseconds delay);
+    void presenceHint(std::chrono::milliseconds within);
+    void watchPresenceHint(PresenceBus& presence);
+    void unwatchPresenceHint(PresenceBus& presence);
+    void readPresenceHints(void);
+    boost::asio::awaitable<void> keepAlive(void);
+    boost::asio::awaitable<void> scanPresenceBus(uint8_t bus);
+    size_t presenceNumber(uint8_t bus, size_t index) const;
+    void rescanPSUEntityManager(
+        uint8_t bus,
+        std::shared_ptr<sdbusplus::asio::connection>& dbusConnection);
+    void discoverSubTree(
+        std::shared_ptr<sdbusplus::asio::connection>& dbusConnection);
+    void applyPSUConfig(const std::string& path, const std::string& interface,
+                        PropertyMapType& propMap);
+    void removePSUConfig(const std::string& path);
+    void loadPSUStates(void);
+    void reconcile(Coalescer::Flags flags);
+    void evaluateRedundancy(void);
+    bool restoreSnapshot(void);
+    void saveSnapshot(void);
+    boost::asio::awaitable<void> applyLastKnownRanks(void);
+    void finishDiscovery(void);
+    boost::asio::awaitable<void>
+        failover(std::chrono::steady_clock::time_point start);
+    void finishTransition(void);
     void saveConfig(void);
-    void saveProperty(std::string propertyName, crConfigVariant value);
+    void flushConfig(void);
+    void saveProperty(const std::string& propertyName,
+                      const crConfigVariant& value);
 
     sdbusplus::asio::object_server& objServer;
+    boost::asio::io_service& io;
+    Pmbus pmbus;
     std::shared_ptr<sdbusplus::asio::connection>& systemBus;
 
-    boost::asio::steady_timer timerRotation;
-    boost::asio::steady_timer warmRedundantTimer;
-    boost::asio::steady_timer timerCheck;
-    boost::asio::steady_timer keepAliveTimer;
-    boost::asio::steady_timer filterTimer;
-    boost::asio::steady_timer puRedundantTimer;
+    PSUTimer timerRotation;
+    // Wall clock time of the last rotation deadline, the next one is a
+    // period later. Epoch until the schedule starts.
+    std::chrono::system_clock::time_point lastRotation;
+    // What happens to deadlines that passed while the daemon was down: one
+    // rotation right away, or skip to the next deadline on the schedule.
+    enum class RotationCatchUp
+    {
+        once,
+        skip
+    };
+    RotationCatchUp rotationCatchUp = RotationCatchUp::once;
+    PSUTimer warmRedundantTimer;
+    PSUTimer timerCheck;
+    PSUTimer keepAliveTimer;
+    Coalescer coalescer;
+
+    // Settings persistence: the values Settings is known to hold and those
+    // still to be written. Writes are issued in batches, a failed batch is
+    // retried with backoff.
+    boost::container::flat_map<std::string, crConfigVariant> savedConfig;
+    boost::container::flat_map<std::string, crConfigVariant> unsavedConfig;
+    size_t savesInFlight = 0;
+    bool saveFailed = false;
+    static constexpr std::chrono::milliseconds saveRetryMin{1000};
+    static constexpr std::chrono::milliseconds saveRetryMax{60000};
+    std::chrono::milliseconds saveRetryDelay = saveRetryMin;
+    PSUTimer saveRetryTimer;
+
+    // PSUs seeded from the snapshot that discovery has not confirmed yet,
+    // by configuration path.
+    boost::container::flat_set<std::string> unconfirmedPSUs;
+    bool snapshotRestored = false;
+    bool discoveryDone = false;
+    // Signal time of a failover waiting for the transition in flight. While
+    // set, rank writes and warm holds stop so the transition unwinds.
+    std::optional<std::chrono::steady_clock::time_point> pendingFailover;
+    // A due rotation waiting for the transition in flight.
+    bool rotationPending = false;
+    // A configCR() waiting for the transition in flight, with its reConfig.
+    std::optional<bool> reRankPending;
+    std::vector<uint8_t> snapshotImage;
 
     std::shared_ptr<sdbusplus::asio::dbus_interface> association;
+    std::shared_ptr<sdbusplus::asio::dbus_interface> metrics;
+    std::shared_ptr<sdbusplus::asio::dbus_interface> rotationSchedule;
     std::vector<Association> associationsOk;
     std::vector<Association> associationsWarning;
     std::vector<Association> associationsNonCrit;
     std::vector<Association> associationsCrit;
 };
-
-class PowerSupply
-{
-  public:
-    PowerSupply(
-        std::string& name, uint8_t bus, uint8_t address, uint8_t order,
-        const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection);
-    ~PowerSupply();
-    std::string name;
-    uint8_t order = 0;
-    uint8_t bus;
-    uint8_t address;
-    PSUState state = PSUState::normal;
-  private:
-    void logVersion();
-};
@@ -0,0 +1,107 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+// How a PSU slot is probed for presence. automatic uses a quick write when the
+// adapter supports SMBus quick commands and a byte read otherwise. A register
+// read addresses a known PMBus command, for PSUs upset by the other two.
+enum class PresenceProbe
+{
+    automatic,
+    quickWrite,
+    readByte,
+    readRegister
+};
+
+// Backend for all I2C access made by the daemon. The i2c* helpers declared in
+// utility.hpp forward to the installed transport, so tests and benchmarks can
+// swap the hardware for a simulated PSU farm. Every call returns 0 (or the
+// number of bytes for block reads) on success and a negative errno on
+// failure, -ENXIO or -EREMOTEIO when the device did not acknowledge.
+class I2CTransport
+{
+  public:
+    virtual ~I2CTransport() = default;
+
+    virtual int set(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                    uint8_t value) = 0;
+    virtual int get(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                    int& value) = 0;
+    virtual int getBlock(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                         int readLength, uint8_t* value) = 0;
+    virtual int setVerify(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                          uint8_t value, int& readback) = 0;
+    virtual bool rdwrSupported(uint8_t bus) = 0;
+    // The probe ping() will use on the bus for the requested one, nullopt if
+    // the adapter supports none that fits.
+    virtual std::optional<PresenceProbe> resolveProbe(uint8_t bus,
+                                                      PresenceProbe probe) = 0;
+    virtual int ping(uint8_t bus, uint8_t slaveAddr, PresenceProbe probe,
+                     uint8_t regAddr) = 0;
+};
+
+// Persistent handle for one /dev/i2c-N adapter. funcs caches the I2C_FUNCS
+// mask and slaveAddr the address last selected with I2C_SLAVE_FORCE, so
+// repeated accesses skip those ioctls.
+struct I2CBusHandle
+{
+    int fd = -1;
+    unsigned long funcs = 0;
+    int slaveAddr = -1;
+};
+
+// Hardware backend using the i2c-dev character devices. Each /dev/i2c-N is
+// opened once and kept in a per-bus pool for the lifetime of the transport.
+class LinuxI2CTransport : public I2CTransport
+{
+  public:
+    ~LinuxI2CTransport() override;
+
+    int set(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+            uint8_t value) override;
+    int get(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+            int& value) override;
+    int getBlock(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                 int readLength, uint8_t* value) override;
+    int setVerify(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                  uint8_t value, int& readback) override;
+    bool rdwrSupported(uint8_t bus) override;
+    std::optional<PresenceProbe> resolveProbe(uint8_t bus,
+                                              PresenceProbe probe) override;
+    int ping(uint8_t bus, uint8_t slaveAddr, PresenceProbe probe,
+             uint8_t regAddr) override;
+
+    // Return the pooled handle for a bus, opening the adapter on first use.
+    // Returns nullptr if the adapter cannot be opened.
+    I2CBusHandle* getBus(uint8_t bus);
+    void closeBus(uint8_t bus);
+
+  private:
+    void checkBusError(uint8_t bus, int err);
+    int selectSlave(I2CBusHandle* handle, uint8_t bus, uint8_t slaveAddr);
+
+    std::array<I2CBusHandle, 256> buses;
+};
+
+// Install the backend used by the i2c* helpers, the Linux backend is used
+// until one is set.
+void setI2CTransport(std::unique_ptr<I2CTransport> transport);
+I2CTransport& i2cTransport(void);
@@ -0,0 +1,238 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <array>
+#include <bit>
+#include <boost/container/flat_map.hpp>
+#include <chrono>
+#include <cstdint>
+#include <sdbusplus/asio/object_server.hpp>
+#include <string>
+#include <vector>
+
+static const constexpr char* metricsInterfaceName =
+    "xyz.openbmc_project.PSURedundancy.Metrics";
+
+// Latency histogram with fixed power of two buckets in microseconds. Bucket 0
+// counts sub-microsecond samples, bucket n counts [2^(n-1), 2^n) and the last
+// bucket is open ended.
+class LatencyHistogram
+{
+  public:
+    static constexpr size_t bucketCount = 28;
+
+    void record(std::chrono::microseconds latency)
+    {
+        uint64_t us = latency.count() > 0 ? latency.count() : 0;
+        size_t bucket = std::bit_width(us);
+        if (bucket >= bucketCount)
+        {
+            bucket = bucketCount - 1;
+        }
+        buckets[bucket]++;
+        count++;
+        totalUs += us;
+        if (us > maxUs)
+        {
+            maxUs = us;
+        }
+    }
+
+    std::array<uint64_t, bucketCount> buckets = {};
+    uint64_t count = 0;
+    uint64_t totalUs = 0;
+    uint64_t maxUs = 0;
+};
+
+// An empty slot NACKing a presence ping is counted in nacks but is not a
+// failure.
+struct I2CCounters
+{
+    uint64_t ops = 0;
+    uint64_t failures = 0;
+    uint64_t nacks = 0;
+    uint64_t retries = 0;
+    uint64_t readbackMismatches = 0;
+};
+
+enum class I2COp
+{
+    set,
+    get,
+    getBlock,
+    setVerify,
+    ping,
+    count
+};
+
+// Counters and latency histograms for every I2C transaction. Storage is fixed
+// or sized when a PSU is registered, so the record path never allocates, and
+// the daemon is single threaded so it takes no locks either.
+class I2CMetrics
+{
+  public:
+    // result is what the transport returned, negative errno on failure.
+    void record(I2COp op, uint8_t bus, uint8_t slaveAddr,
+                std::chrono::steady_clock::time_point start, int result);
+    void recordRetry(uint8_t bus, uint8_t slaveAddr);
+    void recordMismatch(uint8_t bus, uint8_t slaveAddr);
+
+    // Track per-PSU counters for a device, done when the PSU is created.
+    void registerDevice(uint8_t bus, uint8_t slaveAddr,
+                        const std::string& name);
+
+    const LatencyHistogram& histogram(I2COp op) const
+    {
+        return histograms[static_cast<size_t>(op)];
+    }
+    const I2CCounters& opCounters(I2COp op) const
+    {
+        return ops[static_cast<size_t>(op)];
+    }
+    const I2CCounters& busCounters(uint8_t bus) const
+    {
+        return buses[bus];
+    }
+
+    void registerProperties(sdbusplus::asio::dbus_interface& iface);
+
+  private:
+    struct Device
+    {
+        std::string name;
+        uint8_t bus;
+        uint8_t address;
+        I2CCounters counters;
+    };
+
+    I2CCounters* device(uint8_t bus, uint8_t slaveAddr);
+
+    std::array<LatencyHistogram, static_cast<size_t>(I2COp::count)>
+        histograms;
+    std::array<I2CCounters, static_cast<size_t>(I2COp::count)> ops;
+    std::array<I2CCounters, 256> buses;
+    boost::container::flat_map<uint16_t, size_t> deviceIndex;
+    std::vector<Device> devices;
+};
+
+// Cost and effectiveness of PSU presence detection.
+class PresenceMetrics
+{
+  public:
+    void recordScan(std::chrono::steady_clock::time_point start)
+    {
+        scans++;
+        scanCost.record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start));
+    }
+    // Time from the earliest moment a change could have been seen, the last
+    // hint or the previous scan, to the scan that saw it.
+    void recordDetection(std::chrono::steady_clock::duration latency)
+    {
+        changes++;
+        detectionLatency.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(latency));
+    }
+    void recordHint(void)
+    {
+        hints++;
+    }
+    void recordInterval(std::chrono::milliseconds interval)
+    {
+        pollIntervalMs = interval.count();
+    }
+
+    void registerProperties(sdbusplus::asio::dbus_interface& iface);
+
+  private:
+    uint64_t scans = 0;
+    uint64_t changes = 0;
+    uint64_t hints = 0;
+    uint64_t pollIntervalMs = 0;
+    LatencyHistogram scanCost;
+    LatencyHistogram detectionLatency;
+};
+
+// How much signal driven work the coalescer merged.
+class ReconcileMetrics
+{
+  public:
+    void recordEvent(void)
+    {
+        events++;
+    }
+    void recordPass(void)
+    {
+        passes++;
+    }
+
+    void registerProperties(sdbusplus::asio::dbus_interface& iface);
+
+  private:
+    uint64_t events = 0;
+    uint64_t passes = 0;
+};
+
+// Latency of the failover after an active PSU lost AC, measured from the
+// state signal: until every remaining PSU was woken, and until all of them
+// had their new rank.
+class FailoverMetrics
+{
+  public:
+    void recordWake(std::chrono::steady_clock::time_point start)
+    {
+        wakeLatency.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start));
+    }
+    void recordFailover(std::chrono::steady_clock::time_point start)
+    {
+        failovers++;
+        failoverLatency.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start));
+    }
+    // The failover waited for a transition already writing ranks.
+    void recordDeferred(void)
+    {
+        deferred++;
+    }
+
+    const LatencyHistogram& latency(void) const
+    {
+        return failoverLatency;
+    }
+
+    void registerProperties(sdbusplus::asio::dbus_interface& iface);
+
+  private:
+    uint64_t failovers = 0;
+    uint64_t deferred = 0;
+    LatencyHistogram wakeLatency;
+    LatencyHistogram failoverLatency;
+};
+
+I2CMetrics& i2cMetrics(void);
+PresenceMetrics& presenceMetrics(void);
+ReconcileMetrics& reconcileMetrics(void);
+FailoverMetrics& failoverMetrics(void);
+
+// Register all metrics as read-only properties of metricsInterfaceName at
+// path, the values are only assembled when a client reads them.
+std::shared_ptr<sdbusplus::asio::dbus_interface>
+    addMetricsInterface(sdbusplus::asio::object_server& objectServer,
+                        const std::string& path);
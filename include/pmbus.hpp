@@ -0,0 +1,59 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/container/flat_set.hpp>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <psu_clock.hpp>
+
+// Awaitable PMBus transactions executed on the daemon's io_service. Waits
+// between a write and its readback, and between retries, are timer waits so
+// the event loop keeps serving D-Bus while a transaction is in flight.
+class Pmbus
+{
+  public:
+    explicit Pmbus(boost::asio::io_service& io);
+
+    // Write one byte and read it back until it matches or the retries are
+    // exhausted. Returns true when the readback matched. A zero settleDelay
+    // does the write and readback as one I2C_RDWR transfer when the adapter
+    // allows it, otherwise the readback waits settleDelay after the write.
+    boost::asio::awaitable<bool>
+        write(uint8_t bus, uint8_t slaveAddr, uint8_t cmd, uint8_t value,
+              std::chrono::milliseconds settleDelay =
+                  std::chrono::milliseconds(0));
+    // Read one byte, retrying after a delay on failure.
+    boost::asio::awaitable<std::optional<int>> read(uint8_t bus,
+                                                    uint8_t slaveAddr,
+                                                    uint8_t cmd);
+    // Block read into value, returns the number of bytes read or a negative
+    // errno.
+    boost::asio::awaitable<int> readBlock(uint8_t bus, uint8_t slaveAddr,
+                                          uint8_t cmd, int readLength,
+                                          uint8_t* value);
+    // Abort every pending wait, the transactions waiting on them fail.
+    void cancel(void);
+
+  private:
+    boost::asio::awaitable<bool> sleep(std::chrono::milliseconds duration);
+
+    boost::asio::io_service& io;
+    boost::container::flat_set<PSUTimer*> pendingTimers;
+};
@@ -0,0 +1,94 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <optional>
+
+// Clock of the daemon's timers. It follows steady_clock unless a harness
+// switches it to virtual time, which only moves when advanced, so weeks of
+// rotation periods can be simulated without waiting for them.
+class PSUClock
+{
+  public:
+    using duration = std::chrono::steady_clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<PSUClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept;
+
+    // Freeze the clock at its current reading, from then on it only moves
+    // with advanceTo().
+    static void useVirtualTime(void);
+    static bool isVirtual(void);
+    static void advanceTo(time_point when);
+    // Earliest expiry set on a PSUTimer that is still in the future, it may
+    // belong to a timer that was cancelled since.
+    static std::optional<time_point> nextExpiry(void);
+
+    // Wall clock time in step with now(). Under virtual time it moves on
+    // from the reading taken when the clock was frozen.
+    static std::chrono::system_clock::time_point wallNow(void);
+
+    // Called by PSUTimer for every expiry it is given.
+    static void schedule(time_point expiry);
+};
+
+// Under virtual time the reactor must not sleep towards a deadline, it only
+// comes closer when the clock is advanced.
+struct PSUWaitTraits
+{
+    static PSUClock::duration to_wait_duration(const PSUClock::duration& d)
+    {
+        return PSUClock::isVirtual() ? PSUClock::duration::zero() : d;
+    }
+    static PSUClock::duration
+        to_wait_duration(const PSUClock::time_point& t)
+    {
+        return to_wait_duration(t - PSUClock::now());
+    }
+};
+
+// Timer on PSUClock that reports its expiries, so a virtual time driver can
+// step from one deadline to the next.
+class PSUTimer :
+    public boost::asio::basic_waitable_timer<PSUClock, PSUWaitTraits>
+{
+    using Base = boost::asio::basic_waitable_timer<PSUClock, PSUWaitTraits>;
+
+  public:
+    explicit PSUTimer(boost::asio::io_service& io) : Base(io)
+    {
+    }
+    PSUTimer(boost::asio::io_service& io, const duration& expiry) : Base(io)
+    {
+        expires_after(expiry);
+    }
+
+    std::size_t expires_at(const time_point& expiry)
+    {
+        PSUClock::schedule(expiry);
+        return Base::expires_at(expiry);
+    }
+    std::size_t expires_after(const duration& expiry)
+    {
+        return expires_at(PSUClock::now() + expiry);
+    }
+};
@@ -0,0 +1,164 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <boost/container/flat_map.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility.hpp>
+#include <vector>
+
+class PowerSupply
+{
+  public:
+    PowerSupply(std::string& name, uint8_t bus, uint8_t address,
+                uint8_t order);
+    ~PowerSupply();
+    std::string name;
+    uint8_t order = 0;
+    uint8_t bus;
+    uint8_t address;
+    // Entity Manager configuration object the PSU was created from. Indexed
+    // by the registry, it must be set before the PSU is inserted.
+    std::string configPath;
+    PSUState state = PSUState::normal;
+    // Delay between a write and its readback. PSUs configured with zero use
+    // the combined I2C_RDWR write and verify.
+    std::chrono::milliseconds settleDelay{10};
+};
+
+// Refers to one PSU in a PSURegistry. A handle stays valid while other PSUs
+// are inserted or removed and goes stale once its own PSU is removed.
+struct PSUHandle
+{
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+
+    bool operator==(const PSUHandle&) const = default;
+};
+
+// Power supplies in rank order position. The PSUs live in one contiguous slot
+// array with flat indexes on name, bus/address and configuration path, so
+// lookups from status signals and discovery do not scan the list. References
+// and pointers to a PSU are only valid until the next insert.
+class PSURegistry
+{
+    struct Slot
+    {
+        std::optional<PowerSupply> psu;
+        uint32_t generation = 0;
+    };
+
+  public:
+    template <bool isConst>
+    class Iterator
+    {
+      public:
+        using Slots = std::conditional_t<isConst, const std::vector<Slot>,
+                                         std::vector<Slot>>;
+        using Reference =
+            std::conditional_t<isConst, const PowerSupply&, PowerSupply&>;
+
+        Iterator(Slots& slots, std::vector<uint32_t>::const_iterator it) :
+            slots(&slots), it(it)
+        {
+        }
+        Reference operator*() const
+        {
+            return *(*slots)[*it].psu;
+        }
+        Iterator& operator++()
+        {
+            ++it;
+            return *this;
+        }
+        bool operator==(const Iterator& other) const
+        {
+            return it == other.it;
+        }
+        bool operator!=(const Iterator& other) const
+        {
+            return it != other.it;
+        }
+
+      private:
+        Slots* slots;
+        std::vector<uint32_t>::const_iterator it;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    // Append a PSU in the last position. Fails if the name, the bus/address
+    // or a non-empty configuration path is already registered.
+    std::optional<PSUHandle> insert(PowerSupply&& psu);
+    // Remove a PSU, the PSUs behind it move up one position.
+    bool remove(PSUHandle handle);
+    // Update the indexed fields of a PSU.
+    bool rekey(PSUHandle handle, const std::string& name, uint8_t bus,
+               uint8_t address);
+
+    PowerSupply* get(PSUHandle handle);
+    std::optional<PSUHandle> findByName(std::string_view name) const;
+    std::optional<PSUHandle> findByAddress(uint8_t bus,
+                                           uint8_t address) const;
+    std::optional<PSUHandle> findByConfigPath(std::string_view path) const;
+    std::optional<size_t> position(PSUHandle handle) const;
+
+    size_t size() const
+    {
+        return order.size();
+    }
+    bool empty() const
+    {
+        return order.empty();
+    }
+    iterator begin()
+    {
+        return iterator(slots, order.begin());
+    }
+    iterator end()
+    {
+        return iterator(slots, order.end());
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(slots, order.begin());
+    }
+    const_iterator end() const
+    {
+        return const_iterator(slots, order.end());
+    }
+
+  private:
+    static uint16_t addressKey(uint8_t bus, uint8_t address)
+    {
+        return static_cast<uint16_t>((bus << 8) | address);
+    }
+    bool valid(PSUHandle handle) const;
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    // Slot indexes in rank order position.
+    std::vector<uint32_t> order;
+    boost::container::flat_map<std::string, uint32_t, std::less<>> byName;
+    boost::container::flat_map<uint16_t, uint32_t> byAddress;
+    boost::container::flat_map<std::string, uint32_t, std::less<>>
+        byConfigPath;
+};
@@ -0,0 +1,109 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include "i2c_transport.hpp"
+
+#include <boost/container/flat_map.hpp>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// State of one simulated PMBus PSU.
+struct SimPSU
+{
+    bool present = true;
+    // Byte registers, 0xD0 holds the cold redundancy rank.
+    std::array<uint8_t, 256> registers = {};
+    // Returned by a block read of 0xD9, first byte is the byte count.
+    std::vector<uint8_t> revision = {3, 1, 0, 0};
+    // Per-PSU overrides of the farm wide latency and NACK rate, negative
+    // values use the farm setting.
+    std::chrono::microseconds latency{-1};
+    double nackRate = -1.0;
+    // Writes that changed the rank.
+    uint64_t rankChanges = 0;
+
+    uint8_t rank(void) const
+    {
+        return registers[0xD0];
+    }
+    void write(uint8_t regAddr, uint8_t value)
+    {
+        if (regAddr == 0xD0 && registers[regAddr] != value)
+        {
+            rankChanges++;
+        }
+        registers[regAddr] = value;
+    }
+};
+
+// In-memory farm of PMBus PSUs addressed by (bus, address). Each transaction
+// costs the configured latency (the calling thread sleeps, as it would in the
+// i2c-dev ioctl) and is NACKed with the configured probability. Absent PSUs
+// NACK everything.
+class SimulatedI2CTransport : public I2CTransport
+{
+  public:
+    explicit SimulatedI2CTransport(uint32_t seed = 1);
+
+    SimPSU& addPSU(uint8_t bus, uint8_t address);
+    void removePSU(uint8_t bus, uint8_t address);
+    // Returns nullptr if no PSU was added at that address.
+    SimPSU* psu(uint8_t bus, uint8_t address);
+
+    void setLatency(std::chrono::microseconds latency);
+    void setNackRate(double rate);
+    void setRdwrSupported(bool supported);
+    void setQuickSupported(bool supported);
+
+    uint64_t transactions(void) const
+    {
+        return transactionCount;
+    }
+    uint64_t nacks(void) const
+    {
+        return nackCount;
+    }
+
+    int set(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+            uint8_t value) override;
+    int get(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+            int& value) override;
+    int getBlock(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                 int readLength, uint8_t* value) override;
+    int setVerify(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                  uint8_t value, int& readback) override;
+    bool rdwrSupported(uint8_t bus) override;
+    std::optional<PresenceProbe> resolveProbe(uint8_t bus,
+                                              PresenceProbe probe) override;
+    int ping(uint8_t bus, uint8_t slaveAddr, PresenceProbe probe,
+             uint8_t regAddr) override;
+
+  private:
+    // Account for one transaction, returns the addressed PSU or nullptr if
+    // it NACKed.
+    SimPSU* transfer(uint8_t bus, uint8_t slaveAddr);
+
+    boost::container::flat_map<uint16_t, SimPSU> psus;
+    std::chrono::microseconds defaultLatency{0};
+    double defaultNackRate = 0.0;
+    bool rdwr = true;
+    bool quick = true;
+    std::mt19937 rng;
+    uint64_t transactionCount = 0;
+    uint64_t nackCount = 0;
+};
@@ -0,0 +1,60 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// One PSU as last configured.
+struct SnapshotPSU
+{
+    std::string name;
+    std::string configPath;
+    uint8_t bus = 0;
+    uint8_t address = 0;
+    uint8_t order = 0;
+};
+
+// The redundancy configuration and PSU ranks last in effect, kept in a local
+// file so they can be enforced at startup before D-Bus data is available.
+struct Snapshot
+{
+    bool redundancyEnabled = false;
+    bool rotationEnabled = true;
+    std::string algorithm;
+    uint32_t periodOfRotation = 0;
+    std::vector<uint8_t> rankOrder;
+    // Epoch when no rotation was scheduled.
+    std::chrono::system_clock::time_point nextRotation;
+    std::vector<SnapshotPSU> psus;
+};
+
+// Binary image of a snapshot: a header with magic, version, size and a
+// checksum of the body, followed by the fields in native byte order.
+std::vector<uint8_t> encodeSnapshot(const Snapshot& snapshot);
+
+// Map the file at path and decode it, nullopt if it is missing, truncated or
+// does not match its checksum.
+std::optional<Snapshot> readSnapshot(const std::string& path);
+
+// Replace the file at path with image. The image is written to a temporary
+// file in the same directory, synced and renamed over path, so readers see
+// either the previous or the new snapshot. The directory is synced after the
+// rename so the new snapshot survives a power loss.
+bool writeSnapshot(const std::string& path, const std::vector<uint8_t>& image);
@@ -15,12 +15,18 @@
 */
 
 #pragma once
+#include <systemd/sd-bus.h>
+
 #include <boost/container/flat_map.hpp>
 #include <chrono>
 #include <cstdint>
+#include <functional>
+#include <i2c_transport.hpp>
 #include <iostream>
+#include <optional>
 #include <phosphor-logging/lg2.hpp>
 #include <sdbusplus/asio/connection.hpp>
+#include <string_view>
 
 const constexpr char* entityManagerName = "xyz.openbmc_project.EntityManager";
 static const constexpr char* redundancyInterface =
@@ -36,6 +42,10 @@ using BasicVariantType =
 using PropertyMapType =
     boost::container::flat_map<std::string, BasicVariantType>;
 
+using ManagedObjectType = boost::container::flat_map<
+    sdbusplus::message::object_path,
+    boost::container::flat_map<std::string, PropertyMapType>>;
+
 using GetSubTreeType = std::vector<
     std::pair<std::string,
               std::vector<std::pair<std::string, std::vector<std::string>>>>>;
@@ -51,14 +61,35 @@ enum class PSUState
     acLost
 };
 
-void getPSUEvent(
+// Name of the PSU a decorator path such as
+// /xyz/openbmc_project/State/Decorator/PSU1_OperationalStatus belongs to, as
+// a view into path.
+std::optional<std::string_view> psuNameFromStatePath(std::string_view path);
+
+// Read the functional property from an OperationalStatus PropertiesChanged
+// signal straight from the message buffer, nullopt when it did not change or
+// the message is malformed. Nothing is allocated.
+std::optional<bool> readFunctionalChange(sd_bus_message* message);
+
+// PSU name to state, as resolved from the OperationalStatus decorators.
+using PSUStateMap = boost::container::flat_map<std::string, PSUState>;
+
+void getPSUEvents(
     const std::array<const char*, 1>& type,
     const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
-    const std::string& psuName, PSUState& state);
+    std::function<void(const PSUStateMap&)>&& callback);
 
+// I2C helpers, forwarded to the transport installed with setI2CTransport().
 int i2cSet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, uint8_t value);
 int i2cGet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, int& value);
+// Write one byte and read it back in a single I2C_RDWR transfer, only usable
+// when i2cRdwrSupported() is true for the bus.
+int i2cSetVerify(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                 uint8_t value, int& readback);
+bool i2cRdwrSupported(uint8_t bus);
 int i2cGet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, int readLength,
            uint8_t* value);
-int i2cPing(int fd, uint8_t slaveAddr);
-int setPingFd(int& fd, uint64_t bus);
+std::optional<PresenceProbe> i2cResolveProbe(uint8_t bus,
+                                             PresenceProbe probe);
+int i2cPing(uint8_t bus, uint8_t slaveAddr, PresenceProbe probe,
+            uint8_t regAddr);
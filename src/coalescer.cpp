@@ -0,0 +1,94 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "coalescer.hpp"
+
+#include "metrics.hpp"
+
+#include <iostream>
+
+Coalescer::Coalescer(boost::asio::io_service& io,
+                     std::function<void(Flags)>&& reconcile) :
+    timer(io),
+    reconcile(std::move(reconcile))
+{
+}
+
+void Coalescer::setWindow(Flags flags, std::chrono::milliseconds window)
+{
+    for (size_t bit = 0; bit < maxFlags; bit++)
+    {
+        if (flags & (Flags(1) << bit))
+        {
+            windows[bit] = window;
+        }
+    }
+}
+
+void Coalescer::mark(Flags flags)
+{
+    reconcileMetrics().recordEvent();
+    dirty |= flags;
+
+    auto now = PSUClock::now();
+    std::optional<PSUClock::time_point> when;
+    for (size_t bit = 0; bit < maxFlags; bit++)
+    {
+        if (flags & (Flags(1) << bit))
+        {
+            auto due = now + windows[bit];
+            if (!when || due < *when)
+            {
+                when = due;
+            }
+        }
+    }
+    if (when && (!deadline || *when < *deadline))
+    {
+        arm(*when);
+    }
+}
+
+void Coalescer::flush(void)
+{
+    timer.cancel();
+    deadline.reset();
+    Flags flags = dirty;
+    dirty = 0;
+    if (flags == 0)
+    {
+        return;
+    }
+    reconcileMetrics().recordPass();
+    reconcile(flags);
+}
+
+void Coalescer::arm(PSUClock::time_point when)
+{
+    deadline = when;
+    timer.expires_at(when);
+    timer.async_wait([this](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+        else if (ec)
+        {
+            std::cerr << "timer error\n";
+        }
+        flush();
+    });
+}
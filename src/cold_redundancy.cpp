@@ -14,16 +14,26 @@
 // limitations under the License.
 */
 
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <array>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
 #include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/container/flat_set.hpp>
 #include <cold_redundancy.hpp>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <metrics.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 #include <regex>
 #include <sdbusplus/asio/connection.hpp>
@@ -32,7 +42,6 @@
 #include <utility.hpp>
 
 static constexpr const bool debug = false;
-static constexpr const int retryCount = 3;
 static constexpr const std::array<const char*, 3> psuInterfaceTypes = {
     "xyz.openbmc_project.Configuration.pmbus",
     "xyz.openbmc_project.Configuration.PSUPresence",
@@ -44,10 +53,17 @@ static const constexpr char* coldRedundancyPath =
     "/xyz/openbmc_project/control/power_supply_redundancy";
 static const constexpr char* rootPath = "/xyz/openbmc_project/CallbackManager";
 
-static std::vector<std::unique_ptr<PowerSupply>> powerSupplies;
-static std::vector<uint64_t> addrTable = {0};
-static uint8_t psuRescanBus = 7;
-static int pingFd = -1;
+static bool isPSUInterface(const std::string& interface)
+{
+    for (const char* type : psuInterfaceTypes)
+    {
+        if (interface == type)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
 ColdRedundancy::ColdRedundancy(
     boost::asio::io_service& io, sdbusplus::asio::object_server& objectServer,
@@ -56,9 +72,18 @@ ColdRedundancy::ColdRedundancy(
     sdbusplus::xyz::openbmc_project::Control::server::PowerSupplyRedundancy(
         *systemBus, coldRedundancyPath),
     warmRedundantTimer(io), timerRotation(io), timerCheck(io),
-    systemBus(systemBus), keepAliveTimer(io), filterTimer(io),
-    puRedundantTimer(io), objServer(objectServer)
+    systemBus(systemBus), keepAliveTimer(io),
+    coalescer(io, [this](Coalescer::Flags flags) { reconcile(flags); }),
+    saveRetryTimer(io), objServer(objectServer), io(io), pmbus(io)
 {
+    // Inventory churn settles slowest, state changes are debounced as
+    // before, settings writes are applied promptly.
+    coalescer.setWindow(dirtyInventory | dirtyRanks,
+                        std::chrono::milliseconds(1000));
+    coalescer.setWindow(dirtyState, std::chrono::milliseconds(2000));
+    coalescer.setWindow(dirtyConfig | dirtyRankOrder,
+                        std::chrono::milliseconds(200));
+
     associationsOk.emplace_back("", "", "");
     associationsWarning.emplace_back("", "warning", coldRedundancyPath);
     associationsWarning.emplace_back("", "warning", rootPath);
@@ -76,6 +101,14 @@ ColdRedundancy::ColdRedundancy(
         std::cerr << "error initializing assoc interface\n";
     }
 
+    metrics = addMetricsInterface(objectServer, coldRedundancyPath);
+
+    // Microseconds since the epoch, 0 while rotation is disabled.
+    rotationSchedule =
+        objectServer.add_interface(coldRedundancyPath, rotationInterfaceName);
+    rotationSchedule->register_property("NextRotationTime", uint64_t(0));
+    rotationSchedule->initialize();
+
     // For RP platforms, default cold redundancy should be disabled.
     powerSupplyRedundancyEnabled(false);
     // set default configuration
@@ -85,9 +118,17 @@ ColdRedundancy::ColdRedundancy(
     rotationRankOrder({1, 2, 3, 4});
     coldRedundancyStatus(Status::completed);
 
+    // Enforce the last known ranks while D-Bus data is collected.
+    if (restoreSnapshot())
+    {
+        boost::asio::co_spawn(io, applyLastKnownRanks(),
+                              boost::asio::detached);
+    }
+
     // read configuration from settings service
     systemBus->async_method_call(
-        [this](const boost::system::error_code ec, PropertyMapType& propMap) {
+        [this, &io](const boost::system::error_code ec,
+                    PropertyMapType& propMap) {
             if (ec)
             {
                 std::cerr << "Exception happened when get all properties\n";
@@ -121,12 +162,33 @@ ColdRedundancy::ColdRedundancy(
                           << maxRotationPeriod << "seconds)\n";
             }
 
+            // What Settings holds needs no write back.
+            savedConfig["PowerSupplyRedundancyEnabled"] = *redundancyEnabled;
+            savedConfig["RotationEnabled"] = *enabled;
+            savedConfig["RotationAlgorithm"] = *algorithm;
+            savedConfig["RotationRankOrder"] = *rankOrder;
+            savedConfig["PeriodOfRotation"] = *period;
+
+            // The snapshot ranks are already in place when Settings agrees.
+            bool changed =
+                !snapshotRestored ||
+                *redundancyEnabled != powerSupplyRedundancyEnabled() ||
+                *rankOrder != rotationRankOrder();
+
             powerSupplyRedundancyEnabled(*redundancyEnabled);
             rotationAlgorithm(convertAlgoFromString(*algorithm));
             rotationEnabled(*enabled);
             rotationRankOrder(*rankOrder);
 
-            ColdRedundancy::configCR(false);
+            // Settings wins over the snapshot. The startup transition is
+            // usually still writing the last known ranks, configCR then
+            // runs once it has finished.
+            if (changed)
+            {
+                applyRankOrder();
+                boost::asio::co_spawn(io, configCR(false),
+                                      boost::asio::detached);
+            }
             timerRotation.cancel();
             startRotateCR();
         },
@@ -136,130 +198,158 @@ ColdRedundancy::ColdRedundancy(
 
     io.post([this, &io, &objectServer, &systemBus]() {
         createPSU(io, objectServer, systemBus);
+        startRotateCR();
+        startCRCheck();
     });
-    std::function<void(sdbusplus::message::message&)> eventHandler =
-        [this, &io, &objectServer,
-         &systemBus](sdbusplus::message::message& message) {
-            if (message.is_method_error())
+
+    // Entity Manager announces configuration objects as they are probed or
+    // dropped, only the PSU configuration in the signal is applied.
+    std::function<void(sdbusplus::message::message&)> interfacesAdded =
+        [this, &systemBus](sdbusplus::message::message& message) {
+            sdbusplus::message::object_path path;
+            boost::container::flat_map<std::string, PropertyMapType>
+                interfaces;
+            try
+            {
+                message.read(path, interfaces);
+            }
+            catch (const sdbusplus::exception::exception& e)
             {
-                std::cerr << "callback method error\n";
+                std::cerr << "Failed to read InterfacesAdded\n";
                 return;
             }
-            filterTimer.expires_after(std::chrono::seconds(1));
-            filterTimer.async_wait([this, &io, &objectServer, &systemBus](
-                                       const boost::system::error_code& ec) {
-                if (ec == boost::asio::error::operation_aborted)
+            bool applied = false;
+            for (auto& [interface, propMap] : interfaces)
+            {
+                if (isPSUInterface(interface))
                 {
-                    return;
+                    applyPSUConfig(path, interface, propMap);
+                    applied = true;
                 }
-                else if (ec)
+            }
+            if (applied)
+            {
+                coalescer.mark(dirtyInventory);
+            }
+        };
+
+    std::function<void(sdbusplus::message::message&)> interfacesRemoved =
+        [this](sdbusplus::message::message& message) {
+            sdbusplus::message::object_path path;
+            std::vector<std::string> interfaces;
+            try
+            {
+                message.read(path, interfaces);
+            }
+            catch (const sdbusplus::exception::exception& e)
+            {
+                std::cerr << "Failed to read InterfacesRemoved\n";
+                return;
+            }
+            for (const auto& interface : interfaces)
+            {
+                if (isPSUInterface(interface))
                 {
-                    std::cerr << "timer error\n";
+                    removePSUConfig(path);
+                    return;
                 }
-                createPSU(io, objectServer, systemBus);
-            });
+            }
+        };
+
+    // A changed configuration object is re-read on its own instead of
+    // rescanning the whole inventory.
+    std::function<void(sdbusplus::message::message&)> configChanged =
+        [this, &systemBus](sdbusplus::message::message& message) {
+            std::string path = message.get_path();
+            std::string interface;
+            try
+            {
+                message.read(interface);
+            }
+            catch (const sdbusplus::exception::exception& e)
+            {
+                std::cerr << "Failed to read PropertiesChanged\n";
+                return;
+            }
+            systemBus->async_method_call(
+                [this, &systemBus, path,
+                 interface](const boost::system::error_code ec,
+                            PropertyMapType propMap) {
+                    if (ec)
+                    {
+                        std::cerr << "Exception happened when get all "
+                                     "properties\n";
+                        return;
+                    }
+                    applyPSUConfig(path, interface, propMap);
+                    coalescer.mark(dirtyInventory);
+                },
+                message.get_sender(), path, "org.freedesktop.DBus.Properties",
+                "GetAll", interface);
         };
 
     std::function<void(sdbusplus::message::message&)> refreshConfig =
         [this](sdbusplus::message::message& message) {
-            timerRotation.cancel();
-            startRotateCR();
-            timerCheck.cancel();
-            startCRCheck();
-            saveConfig();
-
             std::string objectName;
             boost::container::flat_map<
                 std::string, std::variant<bool, uint8_t, uint32_t, std::string,
                                           std::vector<uint8_t>>>
                 values;
-            message.read(objectName, values);
-
-            for (auto& value : values)
+            try
             {
-                if (value.first == "RotationRankOrder")
-                {
-                    auto pRank =
-                        std::get_if<std::vector<uint8_t>>(&(value.second));
-                    if (pRank == nullptr)
-                    {
-                        continue;
-                    }
-                    uint8_t index = 0;
-                    for (auto& psu : powerSupplies)
-                    {
-                        if (index < pRank->size())
-                        {
-                            psu->order = (*pRank)[index];
-                        }
-                        else
-                        {
-                            psu->order = 0;
-                        }
-                        index++;
-                    }
-                    ColdRedundancy::configCR(false);
+                message.read(objectName, values);
+            }
+            catch (const sdbusplus::exception::exception& e)
+            {
+                std::cerr << "Failed to read redundancy property change\n";
+                return;
+            }
 
-                    break;
-                }
+            Coalescer::Flags flags = dirtyConfig;
+            if (values.contains("RotationRankOrder"))
+            {
+                flags |= dirtyRankOrder;
             }
+            coalescer.mark(flags);
         };
 
+    // Runs for every OperationalStatus change, bursts of these arrive while
+    // PSUs are AC cycled so nothing here allocates.
     std::function<void(sdbusplus::message::message&)> eventCollect =
         [&](sdbusplus::message::message& message) {
-            std::string objectName;
-            boost::container::flat_map<std::string, std::variant<bool>> values;
-            std::string path = message.get_path();
-            std::size_t slantingPos = path.find_last_of("/\\");
-            if ((slantingPos == std::string::npos) ||
-                ((slantingPos + 1) >= path.size()))
+            auto psuName = psuNameFromStatePath(message.get_path());
+            if (!psuName)
             {
-                std::cerr << "Unable to get PSU state name from path\n";
+                std::cerr << "Unable to get PSU name from PSU path\n";
                 return;
             }
-            std::string statePSUName = path.substr(slantingPos + 1);
-            bool stateChanged = false;
-
-            std::size_t hypenPos = statePSUName.find("_");
-            if (hypenPos == std::string::npos)
+            auto handle = powerSupplies.findByName(*psuName);
+            if (!handle)
             {
-                std::cerr << "Unable to get PSU name from PSU path\n";
                 return;
             }
-            std::string psuName = statePSUName.substr(0, hypenPos);
 
-            try
-            {
-                message.read(objectName, values);
-            }
-            catch (const sdbusplus::exception::exception& e)
+            std::optional<bool> functional =
+                readFunctionalChange(message.get());
+            if (!functional)
             {
-                std::cerr << "Failed to read message from PSU Event\n";
                 return;
             }
-
-            for (auto& psu : powerSupplies)
+            PowerSupply& psu = *powerSupplies.get(*handle);
+            bool lost = !*functional && psu.state == PSUState::normal;
+            bool restored = *functional && psu.state == PSUState::acLost;
+            psu.state = *functional ? PSUState::normal : PSUState::acLost;
+            // An active PSU dropped out, the standby ones cannot wait for the
+            // coalesced pass.
+            if (lost && psu.order != 0)
             {
-                if (psu->name != psuName)
-                {
-                    continue;
-                }
-
-                std::string psuEventName = "functional";
-                auto findEvent = values.find(psuEventName);
-                if (findEvent != values.end())
-                {
-                    if (std::get<bool>(findEvent->second))
-                    {
-                        psu->state = PSUState::normal;
-                    }
-                    else
-                    {
-                        psu->state = PSUState::acLost;
-                    }
-                }
+                boost::asio::co_spawn(
+                    io, failover(std::chrono::steady_clock::now()),
+                    boost::asio::detached);
             }
-            checkRedundancyEvent();
+            presenceMetrics().recordHint();
+            presenceHint(presenceFastInterval);
+            coalescer.mark(restored ? dirtyState | dirtyRanks : dirtyState);
         };
 
     for (const char* type : psuInterfaceTypes)
@@ -268,10 +358,26 @@ ColdRedundancy::ColdRedundancy(
             static_cast<sdbusplus::bus::bus&>(*systemBus),
             "type='signal',member='PropertiesChanged',path_namespace='" +
                 std::string(inventoryPath) + "',arg0namespace='" + type + "'",
-            eventHandler);
+            configChanged);
         matches.emplace_back(std::move(match));
     }
 
+    auto addedMatch = std::make_unique<sdbusplus::bus::match::match>(
+        static_cast<sdbusplus::bus::bus&>(*systemBus),
+        sdbusplus::bus::match::rules::interfacesAdded() +
+            sdbusplus::bus::match::rules::argNpath(
+                0, std::string(inventoryPath) + "/"),
+        interfacesAdded);
+    matches.emplace_back(std::move(addedMatch));
+
+    auto removedMatch = std::make_unique<sdbusplus::bus::match::match>(
+        static_cast<sdbusplus::bus::bus&>(*systemBus),
+        sdbusplus::bus::match::rules::interfacesRemoved() +
+            sdbusplus::bus::match::rules::argNpath(
+                0, std::string(inventoryPath) + "/"),
+        interfacesRemoved);
+    matches.emplace_back(std::move(removedMatch));
+
     for (const char* eventType : psuEventInterface)
     {
         auto eventMatch = std::make_unique<sdbusplus::bus::match::match>(
@@ -291,99 +397,442 @@ ColdRedundancy::ColdRedundancy(
             redundancyInterface + "'",
         refreshConfig);
     matches.emplace_back(std::move(configParamMatch));
-
-    io.run();
 }
 
-static std::set<uint8_t> psuPresence;
 static const constexpr uint8_t fruOffsetZero = 0x00;
 
-int pingPSU(const uint8_t& addr)
-{
-    int fruData = 0;
-    return i2cPing(pingFd, addr);
-}
-
-void rescanPSUEntityManager(
+// Ask FruDevice to rescan the bus without blocking the daemon. Requests made
+// while a rescan is outstanding are queued per bus and coalesced, and PSU
+// discovery runs as soon as a rescan completes.
+void ColdRedundancy::rescanPSUEntityManager(
     uint8_t bus, std::shared_ptr<sdbusplus::asio::connection>& dbusConnection)
 {
-    sdbusplus::message::message method = dbusConnection->new_method_call(
+    if (rescanInProgress)
+    {
+        rescanQueue.insert(bus);
+        return;
+    }
+    rescanInProgress = true;
+
+    dbusConnection->async_method_call(
+        [this, &dbusConnection](const boost::system::error_code ec) {
+            rescanInProgress = false;
+            if (ec)
+            {
+                std::cerr << "Failed to rescan entity manager\n";
+            }
+            else
+            {
+                createPSU(io, objServer, dbusConnection);
+            }
+            if (!rescanQueue.empty())
+            {
+                uint8_t next = *rescanQueue.begin();
+                rescanQueue.erase(rescanQueue.begin());
+                rescanPSUEntityManager(next, dbusConnection);
+            }
+        },
         "xyz.openbmc_project.FruDevice", "/xyz/openbmc_project/FruDevice",
-        "xyz.openbmc_project.FruDeviceManager", "ReScanBus");
-    method.append(bus);
+        "xyz.openbmc_project.FruDeviceManager", "ReScanBus", bus);
+}
 
-    try
+// Ping every configured PSU slot, one lane per presence bus.
+boost::asio::awaitable<void> ColdRedundancy::keepAlive(void)
+{
+    if (scanInProgress)
+    {
+        co_return;
+    }
+    scanInProgress = true;
+    presenceChanged = false;
+    auto start = std::chrono::steady_clock::now();
+    auto scanTime = PSUClock::now();
+    std::vector<boost::asio::awaitable<void>> lanes;
+    for (const auto& record : presenceBuses)
+    {
+        lanes.push_back(scanPresenceBus(record.first));
+    }
+    co_await runConcurrently(std::move(lanes));
+    presenceMetrics().recordScan(start);
+    lastPresenceScan = scanTime;
+    presenceHintTime.reset();
+    scanInProgress = false;
+
+    // Poll fast right after a change, back off while the population is
+    // stable.
+    if (presenceChanged)
     {
-        dbusConnection->call(method);
+        presenceInterval = presenceFastInterval;
     }
-    catch (const sdbusplus::exception::exception&)
+    else
+    {
+        presenceInterval = std::min(presenceInterval * 2, presenceSlowInterval);
+    }
+    if (!presenceBuses.empty())
     {
-        std::cerr << "Failed to rescan entity manager\n";
+        keepAliveCheck(presenceInterval);
     }
-    return;
 }
 
-void keepAlive(std::shared_ptr<sdbusplus::asio::connection>& dbusConnection)
+// The pings are synchronous, the lane yields to the io_service after each so
+// other buses and D-Bus traffic are served in between. The record is looked
+// up again after every yield because the configuration may have changed.
+boost::asio::awaitable<void> ColdRedundancy::scanPresenceBus(uint8_t bus)
 {
     bool newPSUFound = false;
-    uint8_t psuNumber = 1;
-    for (const auto& addr : addrTable)
+    for (size_t index = 0;; index++)
     {
-        if (0 == pingPSU(addr))
+        auto record = presenceBuses.find(bus);
+        if (record == presenceBuses.end() ||
+            index >= record->second.addresses.size())
+        {
+            break;
+        }
+        PresenceBus& presence = record->second;
+        bool present = (0 == i2cPing(bus, presence.addresses[index],
+                                     presence.probe, presence.probeRegister));
+        if (present != presence.present[index])
         {
-            auto found = psuPresence.find(addr);
-            if (found == psuPresence.end())
+            presence.present[index] = present;
+            presenceChanged = true;
+            presenceMetrics().recordDetection(
+                PSUClock::now() - presenceHintTime.value_or(lastPresenceScan));
+            std::string psuNumStr =
+                "PSU" + std::to_string(presenceNumber(bus, index));
+            if (present)
             {
                 newPSUFound = true;
-                psuPresence.emplace(addr);
-                std::string psuNumStr = "PSU" + std::to_string(psuNumber);
                 sd_journal_send(
                     "MESSAGE=%s", "New PSU is found", "PRIORITY=%i", LOG_INFO,
                     "REDFISH_MESSAGE_ID=%s", "OpenBMC.0.1.PowerSupplyInserted",
                     "REDFISH_MESSAGE_ARGS=%s", psuNumStr.c_str(), NULL);
             }
-        }
-        else
-        {
-            auto found = psuPresence.find(addr);
-            if (found != psuPresence.end())
+            else
             {
-                psuPresence.erase(addr);
-                std::string psuNumStr = "PSU" + std::to_string(psuNumber);
                 sd_journal_send(
                     "MESSAGE=%s", "One PSU is removed", "PRIORITY=%i", LOG_INFO,
                     "REDFISH_MESSAGE_ID=%s", "OpenBMC.0.1.PowerSupplyRemoved",
                     "REDFISH_MESSAGE_ARGS=%s", psuNumStr.c_str(), NULL);
             }
         }
-        psuNumber++;
+        co_await boost::asio::post(io, boost::asio::use_awaitable);
     }
     if (newPSUFound)
     {
-        rescanPSUEntityManager(psuRescanBus, dbusConnection);
+        rescanPSUEntityManager(bus, systemBus);
+    }
+}
+
+// PSU slots are numbered from 1 across all presence buses in bus order.
+size_t ColdRedundancy::presenceNumber(uint8_t bus, size_t index) const
+{
+    size_t number = index + 1;
+    for (const auto& record : presenceBuses)
+    {
+        if (record.first >= bus)
+        {
+            break;
+        }
+        number += record.second.addresses.size();
+    }
+    return number;
+}
+
+// Seed the configuration and the PSUs from the local snapshot, false when
+// there is none. Discovery later confirms or drops the seeded PSUs.
+bool ColdRedundancy::restoreSnapshot(void)
+{
+    if (std::string_view(PSU_SNAPSHOT_PATH).empty())
+    {
+        return false;
+    }
+    std::optional<Snapshot> snapshot = readSnapshot(PSU_SNAPSHOT_PATH);
+    if (!snapshot)
+    {
+        return false;
+    }
+
+    powerSupplyRedundancyEnabled(snapshot->redundancyEnabled);
+    rotationEnabled(snapshot->rotationEnabled);
+    rotationAlgorithm(convertAlgoFromString(snapshot->algorithm));
+    if (snapshot->periodOfRotation >= minRotationPeriod &&
+        snapshot->periodOfRotation <= maxRotationPeriod)
+    {
+        periodOfRotation(snapshot->periodOfRotation);
+    }
+    rotationRankOrder(snapshot->rankOrder);
+    if (snapshot->nextRotation != std::chrono::system_clock::time_point())
+    {
+        lastRotation = snapshot->nextRotation - rotationPeriod();
+    }
+
+    for (auto& entry : snapshot->psus)
+    {
+        PowerSupply candidate(entry.name, entry.bus, entry.address,
+                              entry.order);
+        candidate.configPath = entry.configPath;
+        auto handle = powerSupplies.insert(std::move(candidate));
+        if (!handle)
+        {
+            continue;
+        }
+        unconfirmedPSUs.insert(entry.configPath);
+        i2cMetrics().registerDevice(entry.bus, entry.address, entry.name);
+    }
+    numberOfPSU = powerSupplies.size();
+    snapshotRestored = true;
+    return true;
+}
+
+// Record the configuration and ranks in effect, the file is only rewritten
+// when they changed.
+void ColdRedundancy::saveSnapshot(void)
+{
+    if (std::string_view(PSU_SNAPSHOT_PATH).empty())
+    {
+        return;
+    }
+    Snapshot snapshot;
+    snapshot.redundancyEnabled = powerSupplyRedundancyEnabled();
+    snapshot.rotationEnabled = rotationEnabled();
+    snapshot.algorithm = convertAlgoToString(rotationAlgorithm());
+    snapshot.periodOfRotation = periodOfRotation();
+    snapshot.rankOrder = rotationRankOrder();
+    if (lastRotation != std::chrono::system_clock::time_point())
+    {
+        snapshot.nextRotation = lastRotation + rotationPeriod();
+    }
+    for (const auto& psu : powerSupplies)
+    {
+        snapshot.psus.push_back(
+            {psu.name, psu.configPath, psu.bus, psu.address, psu.order});
+    }
+
+    std::vector<uint8_t> image = encodeSnapshot(snapshot);
+    if (image == snapshotImage)
+    {
+        return;
+    }
+    if (writeSnapshot(PSU_SNAPSHOT_PATH, image))
+    {
+        snapshotImage = std::move(image);
+    }
+}
+
+// Write the ranks restored from the snapshot. They are what the PSUs held
+// before the restart, so there is no warm hold.
+boost::asio::awaitable<void> ColdRedundancy::applyLastKnownRanks(void)
+{
+    if (!crSupported || !powerSupplyRedundancyEnabled() ||
+        coldRedundancyStatus() == Status::inProgress)
+    {
+        co_return;
+    }
+    coldRedundancyStatus(Status::inProgress);
+    std::vector<PmbusWrite> writes;
+    for (const auto& psu : powerSupplies)
+    {
+        if (psu.order != 0)
+        {
+            writes.push_back(
+                {psu.bus, psu.address, psu.order, psu.settleDelay});
+        }
+    }
+    co_await writeRanks(std::move(writes));
+    finishTransition();
+}
+
+// An active PSU lost AC. Every remaining PSU is woken right away and ranked
+// again without the warm hold, the PSUs are already all active. A transition
+// in flight is stopped after the write it is issuing, so none of its ranks
+// can land after the wake, and the failover runs once it has unwound.
+boost::asio::awaitable<void>
+    ColdRedundancy::failover(std::chrono::steady_clock::time_point start)
+{
+    if (!crSupported || !powerSupplyRedundancyEnabled())
+    {
+        co_return;
+    }
+    if (coldRedundancyStatus() == Status::inProgress)
+    {
+        if (!pendingFailover)
+        {
+            pendingFailover = start;
+            failoverMetrics().recordDeferred();
+        }
+        warmRedundantTimer.cancel();
+        pmbus.cancel();
+        co_return;
+    }
+
+    coldRedundancyStatus(Status::inProgress);
+    co_await putWarmRedundant();
+    if (pendingFailover)
+    {
+        // Another PSU was lost during the wake, start over from the earlier
+        // loss.
+        pendingFailover = std::min(*pendingFailover, start);
+        finishTransition();
+        co_return;
+    }
+    failoverMetrics().recordWake(start);
+    reRanking();
+
+    std::vector<PmbusWrite> writes;
+    for (const auto& psu : powerSupplies)
+    {
+        if (psu.state == PSUState::normal && psu.order != 0)
+        {
+            writes.push_back(
+                {psu.bus, psu.address, psu.order, psu.settleDelay});
+        }
+    }
+    co_await writeRanks(std::move(writes));
+    if (pendingFailover)
+    {
+        pendingFailover = std::min(*pendingFailover, start);
+    }
+    else
+    {
+        failoverMetrics().recordFailover(start);
+    }
+    finishTransition();
+}
+
+// Every transition ends here, a failover that arrived meanwhile runs next.
+// It ranks every PSU again, so a re-rank waiting with it is dropped.
+void ColdRedundancy::finishTransition(void)
+{
+    coldRedundancyStatus(Status::completed);
+    saveSnapshot();
+    if (pendingFailover)
+    {
+        auto start = *pendingFailover;
+        pendingFailover.reset();
+        reRankPending.reset();
+        boost::asio::co_spawn(io, failover(start), boost::asio::detached);
+    }
+    if (reRankPending)
+    {
+        bool reConfig = *reRankPending;
+        reRankPending.reset();
+        boost::asio::co_spawn(io, configCR(reConfig), boost::asio::detached);
+    }
+    if (rotationPending)
+    {
+        rotationPending = false;
+        boost::asio::co_spawn(io, rotateCR(), boost::asio::detached);
     }
 }
 
+// Discovery has completed, seeded PSUs it did not report are gone.
+void ColdRedundancy::finishDiscovery(void)
+{
+    discoveryDone = true;
+    std::vector<std::string> paths(unconfirmedPSUs.begin(),
+                                   unconfirmedPSUs.end());
+    unconfirmedPSUs.clear();
+    for (const auto& path : paths)
+    {
+        removePSUConfig(path);
+    }
+    startRotateCR();
+}
+
+// Queue the properties that differ from what Settings holds, unchanged ones
+// are not written.
 void ColdRedundancy::saveConfig(void)
 {
-    saveProperty("PowerSupplyRedundancyEnabled",
-                 powerSupplyRedundancyEnabled());
-    saveProperty("RotationEnabled", rotationEnabled());
-    saveProperty("RotationAlgorithm", convertAlgoToString(rotationAlgorithm()));
-    saveProperty("RotationRankOrder", rotationRankOrder());
-    saveProperty("PeriodOfRotation", periodOfRotation());
+    const std::array<std::pair<const char*, crConfigVariant>, 5> config = {
+        {{"PowerSupplyRedundancyEnabled", powerSupplyRedundancyEnabled()},
+         {"RotationEnabled", rotationEnabled()},
+         {"RotationAlgorithm", convertAlgoToString(rotationAlgorithm())},
+         {"RotationRankOrder", rotationRankOrder()},
+         {"PeriodOfRotation", periodOfRotation()}}};
+
+    for (const auto& [name, value] : config)
+    {
+        auto saved = savedConfig.find(name);
+        if (saved != savedConfig.end() && saved->second == value)
+        {
+            unsavedConfig.erase(name);
+        }
+        else
+        {
+            unsavedConfig[name] = value;
+        }
+    }
+    if (!saveFailed)
+    {
+        flushConfig();
+    }
+}
+
+// Write the unsaved properties, Settings has no batch setter so it is one
+// Set per property. A new batch starts only when the previous one is done.
+void ColdRedundancy::flushConfig(void)
+{
+    if (savesInFlight > 0)
+    {
+        return;
+    }
+    saveFailed = false;
+    savesInFlight = unsavedConfig.size();
+    for (const auto& [name, value] : unsavedConfig)
+    {
+        saveProperty(name, value);
+    }
 }
 
-void ColdRedundancy::saveProperty(std::string propertyName,
-                                  crConfigVariant value)
+void ColdRedundancy::saveProperty(const std::string& propertyName,
+                                  const crConfigVariant& value)
 {
     systemBus->async_method_call(
-        [this](const boost::system::error_code ec) {
+        [this, propertyName, value](const boost::system::error_code ec) {
+            savesInFlight--;
             if (ec)
             {
-                std::cerr << "Failled to save config to Settings service\n";
+                std::cerr << "Failed to save " << propertyName
+                          << " to Settings service\n";
+                saveFailed = true;
+            }
+            else
+            {
+                savedConfig[propertyName] = value;
+                auto unsaved = unsavedConfig.find(propertyName);
+                if (unsaved != unsavedConfig.end() && unsaved->second == value)
+                {
+                    unsavedConfig.erase(unsaved);
+                }
+            }
+            if (savesInFlight > 0)
+            {
+                return;
+            }
+            if (unsavedConfig.empty())
+            {
+                saveFailed = false;
+                saveRetryDelay = saveRetryMin;
+                return;
+            }
+            if (!saveFailed)
+            {
+                // Values changed while the batch was in flight.
+                flushConfig();
                 return;
             }
+            std::cerr << "Retrying Settings save in " << saveRetryDelay.count()
+                      << "ms\n";
+            saveRetryTimer.expires_after(saveRetryDelay);
+            saveRetryDelay = std::min(saveRetryDelay * 2, saveRetryMax);
+            saveRetryTimer.async_wait(
+                [this](const boost::system::error_code& ec) {
+                    if (ec == boost::asio::error::operation_aborted)
+                    {
+                        return;
+                    }
+                    flushConfig();
+                });
         },
         "xyz.openbmc_project.Settings",
         "/xyz/openbmc_project/control/power_supply_redundancy",
@@ -399,10 +848,66 @@ void ColdRedundancy::createPSU(
     boost::asio::io_service& io, sdbusplus::asio::object_server& objectServer,
     std::shared_ptr<sdbusplus::asio::connection>& conn)
 {
-    // call mapper to get matched obj paths
-    conn->async_method_call(
+    if (discoveryMode == DiscoveryMode::subTree)
+    {
+        discoverSubTree(conn);
+        return;
+    }
+
+    // One call returns every configuration object Entity Manager owns, the
+    // PSU entries are applied together before redundancy is evaluated.
+    conn->async_method_call(
         [this, &conn](const boost::system::error_code ec,
-                      GetSubTreeType subtree) {
+                      ManagedObjectType objects) {
+            if (ec)
+            {
+                std::cerr << "Failed to get Entity Manager objects, falling "
+                             "back to ObjectMapper\n";
+                discoverSubTree(conn);
+                return;
+            }
+            for (auto& [path, interfaces] : objects)
+            {
+                for (auto& [interface, propMap] : interfaces)
+                {
+                    if (isPSUInterface(interface))
+                    {
+                        applyPSUConfig(path, interface, propMap);
+                    }
+                }
+            }
+            finishDiscovery();
+            coalescer.mark(dirtyInventory);
+        },
+        entityManagerName, "/", "org.freedesktop.DBus.ObjectManager",
+        "GetManagedObjects");
+}
+
+// PSU configuration read through the mapper, one GetAll per interface. The
+// replies are collected and applied only once all of them have arrived.
+void ColdRedundancy::discoverSubTree(
+    std::shared_ptr<sdbusplus::asio::connection>& conn)
+{
+    struct Discovery
+    {
+        size_t outstanding = 0;
+        std::vector<std::tuple<std::string, std::string, PropertyMapType>>
+            configs;
+    };
+
+    auto applyAll = [this](Discovery& discovery) {
+        for (auto& [path, interface, propMap] : discovery.configs)
+        {
+            applyPSUConfig(path, interface, propMap);
+        }
+        finishDiscovery();
+        coalescer.mark(dirtyInventory);
+    };
+
+    // call mapper to get matched obj paths
+    conn->async_method_call(
+        [this, &conn, applyAll](const boost::system::error_code ec,
+                                GetSubTreeType subtree) {
             if (ec)
             {
                 std::cerr << "Exception happened when communicating to "
@@ -413,6 +918,7 @@ void ColdRedundancy::createPSU(
             {
                 std::cerr << "get valid subtree\n";
             }
+            auto discovery = std::make_shared<Discovery>();
             for (const auto& object : subtree)
             {
                 std::string pathName = object.first;
@@ -422,20 +928,12 @@ void ColdRedundancy::createPSU(
                     for (const auto& interface : serviceIface.second)
                     {
                         // only get property of matched interface
-                        bool isIfaceMatched = false;
-                        for (const auto& type : psuInterfaceTypes)
-                        {
-                            if (type == interface)
-                            {
-                                isIfaceMatched = true;
-                                break;
-                            }
-                        }
-                        if (!isIfaceMatched)
+                        if (!isPSUInterface(interface))
                             continue;
 
+                        discovery->outstanding++;
                         conn->async_method_call(
-                            [this, &conn,
+                            [discovery, applyAll, pathName,
                              interface](const boost::system::error_code ec,
                                         PropertyMapType propMap) {
                                 if (ec)
@@ -443,104 +941,17 @@ void ColdRedundancy::createPSU(
                                     std::cerr
                                         << "Exception happened when get all "
                                            "properties\n";
-                                    return;
                                 }
-                                if (debug)
+                                else
                                 {
-                                    std::cerr << "get valid propMap\n";
+                                    discovery->configs.emplace_back(
+                                        pathName, interface,
+                                        std::move(propMap));
                                 }
-
-                                auto configName =
-                                    std::get_if<std::string>(&propMap["Name"]);
-                                if (configName == nullptr)
-                                {
-                                    std::cerr << "error finding necessary "
-                                                 "entry in configuration\n";
-                                    return;
-                                }
-
-                                if (interface == "xyz.openbmc_project."
-                                                 "Configuration.PURedundancy")
+                                if (--discovery->outstanding == 0)
                                 {
-                                    uint8_t* minNumNeeded =
-                                        std::get_if<uint8_t>(
-                                            &propMap["RedundantCount"]);
-                                    if (minNumNeeded != nullptr)
-                                    {
-                                        redundantCount(*minNumNeeded);
-                                    }
-                                    else
-                                    {
-                                        std::cerr << "Failed to get Power Unit "
-                                                     "Redundancy count, will "
-                                                     "use default value\n";
-                                    }
-                                    return;
+                                    applyAll(*discovery);
                                 }
-                                else if (interface ==
-                                         "xyz.openbmc_project."
-                                         "Configuration.PSUPresence")
-                                {
-                                    auto psuBus =
-                                        std::get_if<uint64_t>(&propMap["Bus"]);
-                                    auto psuAddress =
-                                        std::get_if<std::vector<uint64_t>>(
-                                            &propMap["Address"]);
-
-                                    if (psuBus == nullptr ||
-                                        psuAddress == nullptr)
-                                    {
-                                        std::cerr << "error finding necessary "
-                                                     "entry in configuration\n";
-                                        return;
-                                    }
-                                    psuRescanBus = *psuBus;
-                                    addrTable = *psuAddress;
-                                    if (setPingFd(pingFd, *psuBus))
-                                    {
-                                        return;
-                                    }
-                                    keepAliveCheck();
-                                    return;
-                                }
-
-                                auto configBus =
-                                    std::get_if<uint64_t>(&propMap["Bus"]);
-                                auto configAddress =
-                                    std::get_if<uint64_t>(&propMap["Address"]);
-
-                                if (configBus == nullptr ||
-                                    configAddress == nullptr)
-                                {
-                                    std::cerr << "error finding necessary "
-                                                 "entry in configuration\n";
-                                    return;
-                                }
-                                for (auto& psu : powerSupplies)
-                                {
-                                    if ((static_cast<uint8_t>(*configBus) ==
-                                         psu->bus) &&
-                                        (static_cast<uint8_t>(*configAddress) ==
-                                         psu->address))
-                                    {
-                                        return;
-                                    }
-                                }
-
-                                uint8_t order = 0;
-                                if (numberOfPSU < rotationRankOrder().size())
-                                {
-                                    order = rotationRankOrder()[numberOfPSU];
-                                }
-
-                                powerSupplies.emplace_back(
-                                    std::make_unique<PowerSupply>(
-                                        *configName,
-                                        static_cast<uint8_t>(*configBus),
-                                        static_cast<uint8_t>(*configAddress),
-                                        order, conn));
-
-                                numberOfPSU++;
                             },
                             serviceName.c_str(), pathName.c_str(),
                             "org.freedesktop.DBus.Properties", "GetAll",
@@ -548,19 +959,306 @@ void ColdRedundancy::createPSU(
                     }
                 }
             }
-            checkRedundancyEvent();
+            if (discovery->outstanding == 0)
+            {
+                applyAll(*discovery);
+            }
         },
         "xyz.openbmc_project.ObjectMapper",
         "/xyz/openbmc_project/object_mapper",
         "xyz.openbmc_project.ObjectMapper", "GetSubTree",
         "/xyz/openbmc_project/inventory/system", psuDepth, psuInterfaceTypes);
-    startRotateCR();
-    startCRCheck();
 }
 
-void ColdRedundancy::keepAliveCheck(void)
+// Takes the PSU by value: the coroutine only starts after the spawning call
+// returns, by then the registry may have moved or removed the PSU.
+static boost::asio::awaitable<void> logVersion(Pmbus& pmbus, std::string name,
+                                               uint8_t bus, uint8_t address)
+{
+    constexpr uint8_t deviceRevOffset = 0xD9;
+    constexpr int readLength = 4;
+    uint8_t byteArr[readLength];
+    std::string version = "VERSION INFO - " + name + " - ";
+    if (co_await pmbus.readBlock(bus, address, deviceRevOffset, readLength,
+                                 byteArr) != readLength)
+    {
+        std::cerr << "Failure to read Power Supply version!\n";
+        co_return;
+    }
+    // First byte of byteArr is the number of bytes read, so it is skipped.
+    for (int i = 1; i < readLength; i++)
+    {
+        version += std::to_string(unsigned(byteArr[i]));
+        if (i != (readLength - 1))
+        {
+            version += ".";
+        }
+    }
+    std::cout << version << "\n";
+}
+
+// Apply one Entity Manager configuration interface found at path. A pmbus
+// configuration that is already known by its path is updated in place.
+void ColdRedundancy::applyPSUConfig(const std::string& path,
+                                    const std::string& interface,
+                                    PropertyMapType& propMap)
 {
-    keepAliveTimer.expires_after(std::chrono::seconds(2));
+    if (debug)
+    {
+        std::cerr << "get valid propMap\n";
+    }
+
+    auto configName = std::get_if<std::string>(&propMap["Name"]);
+    if (configName == nullptr)
+    {
+        std::cerr << "error finding necessary entry in configuration\n";
+        return;
+    }
+
+    if (interface == "xyz.openbmc_project.Configuration.PURedundancy")
+    {
+        uint8_t* minNumNeeded =
+            std::get_if<uint8_t>(&propMap["RedundantCount"]);
+        if (minNumNeeded != nullptr)
+        {
+            redundantCount(*minNumNeeded);
+        }
+        else
+        {
+            std::cerr << "Failed to get Power Unit Redundancy count, will use "
+                         "default value\n";
+        }
+        // Optional coalescing windows, in milliseconds.
+        const std::array<std::pair<const char*, Coalescer::Flags>, 3>
+            windows = {{{"InventoryWindowMs", dirtyInventory | dirtyRanks},
+                        {"StateWindowMs", dirtyState},
+                        {"ConfigWindowMs", dirtyConfig | dirtyRankOrder}}};
+        for (const auto& [property, flags] : windows)
+        {
+            auto window = std::get_if<uint64_t>(&propMap[property]);
+            if (window != nullptr)
+            {
+                coalescer.setWindow(flags, std::chrono::milliseconds(*window));
+            }
+        }
+        auto catchUp = std::get_if<std::string>(&propMap["RotationCatchUp"]);
+        if (catchUp != nullptr)
+        {
+            if (*catchUp == "Once")
+            {
+                rotationCatchUp = RotationCatchUp::once;
+            }
+            else if (*catchUp == "Skip")
+            {
+                rotationCatchUp = RotationCatchUp::skip;
+            }
+            else
+            {
+                std::cerr << "Unknown rotation catch up " << *catchUp
+                          << ", will use Once\n";
+                rotationCatchUp = RotationCatchUp::once;
+            }
+        }
+        auto mode = std::get_if<std::string>(&propMap["RotationMode"]);
+        if (mode != nullptr)
+        {
+            if (*mode == "AllWarm")
+            {
+                rotationMode = RotationMode::allWarm;
+            }
+            else if (*mode == "Minimal")
+            {
+                rotationMode = RotationMode::minimal;
+            }
+            else
+            {
+                std::cerr << "Unknown rotation mode " << *mode
+                          << ", will use AllWarm\n";
+                rotationMode = RotationMode::allWarm;
+            }
+        }
+        return;
+    }
+    else if (interface == "xyz.openbmc_project.Configuration.PSUPresence")
+    {
+        auto psuBus = std::get_if<uint64_t>(&propMap["Bus"]);
+        auto psuAddress =
+            std::get_if<std::vector<uint64_t>>(&propMap["Address"]);
+
+        if (psuBus == nullptr || psuAddress == nullptr)
+        {
+            std::cerr << "error finding necessary entry in configuration\n";
+            return;
+        }
+        uint8_t bus = static_cast<uint8_t>(*psuBus);
+        PresenceProbe requested = PresenceProbe::automatic;
+        auto probeName = std::get_if<std::string>(&propMap["Probe"]);
+        if (probeName != nullptr)
+        {
+            if (*probeName == "QuickWrite")
+            {
+                requested = PresenceProbe::quickWrite;
+            }
+            else if (*probeName == "ReadByte")
+            {
+                requested = PresenceProbe::readByte;
+            }
+            else if (*probeName == "Register")
+            {
+                requested = PresenceProbe::readRegister;
+            }
+            else if (*probeName != "Auto")
+            {
+                std::cerr << "Unknown presence probe " << *probeName
+                          << ", detecting\n";
+            }
+        }
+        std::optional<PresenceProbe> probe = i2cResolveProbe(bus, requested);
+        if (!probe)
+        {
+            std::cerr << "PSU presence bus " << static_cast<int>(bus)
+                      << " cannot be probed\n";
+            return;
+        }
+        PresenceBus& presence = presenceBuses[bus];
+        presence.probe = *probe;
+        auto probeRegister = std::get_if<uint64_t>(&propMap["ProbeRegister"]);
+        if (probeRegister != nullptr)
+        {
+            presence.probeRegister = static_cast<uint8_t>(*probeRegister);
+        }
+        if (!presence.configPath.empty() && presence.configPath != path)
+        {
+            std::cerr << "PSU presence for bus " << static_cast<int>(bus)
+                      << " configured twice, using " << path << "\n";
+        }
+        presence.configPath = path;
+        std::vector<uint8_t> addresses(psuAddress->begin(), psuAddress->end());
+        if (addresses != presence.addresses)
+        {
+            presence.addresses = std::move(addresses);
+            presence.present.assign(presence.addresses.size(), false);
+        }
+        auto hintFile = std::get_if<std::string>(&propMap["HintFile"]);
+        if (hintFile != nullptr && *hintFile != presence.hintFile)
+        {
+            unwatchPresenceHint(presence);
+            presence.hintFile = *hintFile;
+            watchPresenceHint(presence);
+        }
+        presenceHint(std::chrono::milliseconds(0));
+        return;
+    }
+
+    auto configBus = std::get_if<uint64_t>(&propMap["Bus"]);
+    auto configAddress = std::get_if<uint64_t>(&propMap["Address"]);
+
+    if (configBus == nullptr || configAddress == nullptr)
+    {
+        std::cerr << "error finding necessary entry in configuration\n";
+        return;
+    }
+    auto settleDelay = std::get_if<uint64_t>(&propMap["SettleDelay"]);
+
+    auto handle = powerSupplies.findByConfigPath(path);
+    if (handle)
+    {
+        unconfirmedPSUs.erase(path);
+        if (!powerSupplies.rekey(*handle, *configName,
+                                 static_cast<uint8_t>(*configBus),
+                                 static_cast<uint8_t>(*configAddress)))
+        {
+            std::cerr << "Duplicate PSU configuration at " << path << "\n";
+            return;
+        }
+        PowerSupply& psu = *powerSupplies.get(*handle);
+        if (settleDelay != nullptr)
+        {
+            psu.settleDelay = std::chrono::milliseconds(*settleDelay);
+        }
+        i2cMetrics().registerDevice(psu.bus, psu.address, psu.name);
+        return;
+    }
+
+    uint8_t order = 0;
+    if (numberOfPSU < rotationRankOrder().size())
+    {
+        order = rotationRankOrder()[numberOfPSU];
+    }
+
+    PowerSupply candidate(*configName, static_cast<uint8_t>(*configBus),
+                          static_cast<uint8_t>(*configAddress), order);
+    candidate.configPath = path;
+    if (settleDelay != nullptr)
+    {
+        candidate.settleDelay = std::chrono::milliseconds(*settleDelay);
+    }
+    if (powerSupplies.findByAddress(candidate.bus, candidate.address))
+    {
+        std::cerr << "Duplicate PSU address at " << path << "\n";
+        return;
+    }
+    handle = powerSupplies.insert(std::move(candidate));
+    if (!handle)
+    {
+        return;
+    }
+    PowerSupply& psu = *powerSupplies.get(*handle);
+    i2cMetrics().registerDevice(psu.bus, psu.address, psu.name);
+    boost::asio::co_spawn(io, logVersion(pmbus, psu.name, psu.bus, psu.address),
+                          boost::asio::detached);
+
+    numberOfPSU++;
+    // PSUs found by the initial discovery are ranked from the settings.
+    if (discoveryDone)
+    {
+        coalescer.mark(dirtyRanks);
+    }
+}
+
+// Forget the configuration Entity Manager removed from path. Removing a PSU
+// shifts the positional rank order, so the ranks are rebuilt.
+void ColdRedundancy::removePSUConfig(const std::string& path)
+{
+    auto presence = std::find_if(presenceBuses.begin(), presenceBuses.end(),
+                                 [&path](const auto& record) {
+                                     return record.second.configPath == path;
+                                 });
+    if (presence != presenceBuses.end())
+    {
+        unwatchPresenceHint(presence->second);
+        presenceBuses.erase(presence);
+        if (presenceBuses.empty())
+        {
+            keepAliveTimer.cancel();
+        }
+        return;
+    }
+
+    auto handle = powerSupplies.findByConfigPath(path);
+    if (!handle)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> orders = rotationRankOrder();
+    size_t index = *powerSupplies.position(*handle);
+    if (index < orders.size())
+    {
+        orders.erase(orders.begin() + index);
+        rotationRankOrder(orders);
+    }
+    powerSupplies.remove(*handle);
+    numberOfPSU = powerSupplies.size();
+
+    coalescer.mark(dirtyState | dirtyRanks);
+}
+
+// Schedule the next presence scan, the scan schedules the one after.
+void ColdRedundancy::keepAliveCheck(std::chrono::milliseconds delay)
+{
+    presenceMetrics().recordInterval(delay);
+    keepAliveTimer.expires_after(delay);
     keepAliveTimer.async_wait([&](const boost::system::error_code& ec) {
         if (ec == boost::asio::error::operation_aborted)
         {
@@ -570,52 +1268,135 @@ void ColdRedundancy::keepAliveCheck(void)
         {
             std::cerr << "timer error\n";
         }
-        keepAlive(systemBus);
-        keepAliveCheck();
+        boost::asio::co_spawn(io, keepAlive(), boost::asio::detached);
     });
 }
 
-uint8_t ColdRedundancy::psuNumber() const
-{
-    return numberOfPSU;
-}
-
-PowerSupply::PowerSupply(
-    std::string& name, uint8_t bus, uint8_t address, uint8_t order,
-    const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection) :
-    name(name),
-    bus(bus), address(address), order(order)
+// Something suggests the PSU population may change: a hint file was touched
+// or a PSU changed state. Go back to fast polling and scan within the given
+// time unless a scan is already due sooner or running.
+void ColdRedundancy::presenceHint(std::chrono::milliseconds within)
 {
-    getPSUEvent(psuEventInterface, dbusConnection, name, state);
-    if (debug)
+    presenceInterval = presenceFastInterval;
+    if (!presenceHintTime)
     {
-        std::cerr << "psu state " << static_cast<int>(state) << "\n";
+        presenceHintTime = PSUClock::now();
+    }
+    if (presenceBuses.empty() || scanInProgress)
+    {
+        return;
+    }
+    // An expiry in the past means no scan is scheduled.
+    auto now = PSUClock::now();
+    if (keepAliveTimer.expiry() <= now ||
+        keepAliveTimer.expiry() > now + within)
+    {
+        keepAliveCheck(within);
     }
-    logVersion();
 }
 
-void PowerSupply::logVersion()
+// Hint files are written by whatever sees insertions first, e.g. a udev rule
+// or a GPIO monitor, so insertions are found without waiting for a poll.
+// sysfs GPIO value files do not raise inotify events and cannot be used
+// directly.
+void ColdRedundancy::watchPresenceHint(PresenceBus& presence)
 {
-    constexpr uint8_t deviceRevOffset = 0xD9;
-    constexpr int readLength = 4;
-    uint8_t byteArr[readLength];
-    if (i2cGet(bus, address, deviceRevOffset, readLength, byteArr) !=
-        readLength)
+    if (presence.hintFile.empty())
     {
-        std::cerr << "Failure to read Power Supply version!\n";
         return;
     }
-    std::string version = "VERSION INFO - " + name + " - ";
-    // First byte of byteArr is the number of bytes read, so it is skipped.
-    for (int i = 1; i < readLength; i++)
+    if (!hintWatcher)
     {
-        version += std::to_string(unsigned(byteArr[i]));
-        if (i != (readLength - 1))
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
         {
-            version += ".";
+            std::cerr << "Failed to initialize inotify\n";
+            return;
         }
+        hintWatcher.emplace(io, fd);
+        readPresenceHints();
     }
-    std::cout << version << "\n";
+    presence.hintWatch =
+        inotify_add_watch(hintWatcher->native_handle(),
+                          presence.hintFile.c_str(),
+                          IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB);
+    if (presence.hintWatch < 0)
+    {
+        std::cerr << "Failed to watch " << presence.hintFile << "\n";
+    }
+}
+
+void ColdRedundancy::unwatchPresenceHint(PresenceBus& presence)
+{
+    if (hintWatcher && presence.hintWatch >= 0)
+    {
+        inotify_rm_watch(hintWatcher->native_handle(), presence.hintWatch);
+    }
+    presence.hintWatch = -1;
+}
+
+void ColdRedundancy::readPresenceHints(void)
+{
+    hintWatcher->async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [this](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+            else if (ec)
+            {
+                std::cerr << "inotify error\n";
+                return;
+            }
+            // Only the fact that a hint file changed matters, drain the
+            // events.
+            while (::read(hintWatcher->native_handle(), hintEvents.data(),
+                          hintEvents.size()) > 0)
+            {
+            }
+            presenceMetrics().recordHint();
+            presenceHint(std::chrono::milliseconds(0));
+            readPresenceHints();
+        });
+}
+
+uint8_t ColdRedundancy::psuNumber() const
+{
+    return numberOfPSU;
+}
+
+PowerSupply::PowerSupply(std::string& name, uint8_t bus, uint8_t address,
+                         uint8_t order) :
+    name(name),
+    bus(bus), address(address), order(order)
+{
+}
+
+// Refresh the state of all PSUs from their decorators and evaluate
+// redundancy once every state is known. PSUs are looked up by name when the
+// reply arrives, one removed in the meantime is simply not updated.
+void ColdRedundancy::loadPSUStates(void)
+{
+    getPSUEvents(psuEventInterface, systemBus,
+                 [this](const PSUStateMap& states) {
+                     for (auto& psu : powerSupplies)
+                     {
+                         auto find = states.find(psu.name);
+                         if (find == states.end())
+                         {
+                             continue;
+                         }
+                         psu.state = find->second;
+                         if (debug)
+                         {
+                             std::cerr << psu.name << " state "
+                                       << static_cast<int>(psu.state)
+                                       << "\n";
+                         }
+                     }
+                     evaluateRedundancy();
+                 });
 }
 
 // Reranking PSU orders with ascending order, if any of the PSU is not in
@@ -632,17 +1413,17 @@ void ColdRedundancy::reRanking(void)
     {
         for (auto& psu : powerSupplies)
         {
-            if (psu->state == PSUState::normal)
+            if (psu.state == PSUState::normal)
             {
-                psu->order = (index++);
+                psu.order = (index++);
             }
             else
             {
-                psu->order = 0;
+                psu.order = 0;
             }
             if (psuNumber < orders.size())
             {
-                orders[psuNumber++] = psu->order;
+                orders[psuNumber++] = psu.order;
             }
             else
             {
@@ -660,7 +1441,7 @@ void ColdRedundancy::reRanking(void)
     {
         for (auto& psu : powerSupplies)
         {
-            if (psu->state == PSUState::acLost)
+            if (psu.state == PSUState::acLost)
             {
                 rotationAlgorithm(Algo::bmcSpecific);
                 reRanking();
@@ -670,74 +1451,86 @@ void ColdRedundancy::reRanking(void)
     }
 }
 
-void ColdRedundancy::configCR(bool reConfig)
+// Write the ranks again after every PSU was held warm, rebuilding them first
+// when reConfig is set. Requested during a transition, it runs once that one
+// has finished.
+boost::asio::awaitable<void> ColdRedundancy::configCR(bool reConfig)
 {
-    if (!crSupported || !powerSupplyRedundancyEnabled() ||
-        coldRedundancyStatus() == Status::inProgress)
+    if (!crSupported || !powerSupplyRedundancyEnabled())
     {
-        return;
+        co_return;
+    }
+    if (coldRedundancyStatus() == Status::inProgress)
+    {
+        reRankPending = reRankPending.value_or(false) || reConfig;
+        co_return;
     }
     timerRotation.cancel();
     timerCheck.cancel();
     startRotateCR();
     startCRCheck();
     coldRedundancyStatus(Status::inProgress);
-    putWarmRedundant();
+    co_await putWarmRedundant();
 
-    warmRedundantTimer.expires_after(std::chrono::seconds(5));
-    warmRedundantTimer.async_wait(
-        [this, reConfig](const boost::system::error_code& ec) {
-            if (ec == boost::asio::error::operation_aborted)
-            {
-                coldRedundancyStatus(Status::completed);
-                return;
-            }
-            else if (ec)
-            {
-                coldRedundancyStatus(Status::completed);
-                std::cerr << "warm redundant timer error\n";
-                return;
-            }
+    if (!co_await waitWarmRedundant())
+    {
+        finishTransition();
+        co_return;
+    }
 
-            if (reConfig)
-            {
-                reRanking();
-            }
+    if (reConfig)
+    {
+        reRanking();
+    }
 
-            for (auto& psu : powerSupplies)
-            {
-                if (psu->state == PSUState::normal && psu->order != 0)
-                {
-                    writePmbus(psu->bus, psu->address, psu->order);
-                }
-            }
-            coldRedundancyStatus(Status::completed);
-        });
+    std::vector<PmbusWrite> writes;
+    for (auto& psu : powerSupplies)
+    {
+        if (psu.state == PSUState::normal && psu.order != 0)
+        {
+            writes.push_back(
+                {psu.bus, psu.address, psu.order, psu.settleDelay});
+        }
+    }
+    co_await writeRanks(std::move(writes));
+    finishTransition();
 }
 
-void ColdRedundancy::checkCR(void)
+boost::asio::awaitable<void> ColdRedundancy::checkCR(void)
 {
     if (!crSupported)
     {
-        return;
+        co_return;
     }
     if (!powerSupplyRedundancyEnabled())
     {
-        putWarmRedundant();
-        return;
+        co_await putWarmRedundant();
+        co_return;
+    }
+    // A transition is already rewriting the ranks, do not race with it.
+    if (coldRedundancyStatus() == Status::inProgress)
+    {
+        co_return;
     }
 
+    std::vector<std::pair<uint8_t, uint8_t>> targets;
     for (auto& psu : powerSupplies)
     {
-        if (psu->state == PSUState::normal)
+        if (psu.state == PSUState::normal)
         {
-            int order = -1;
-            readPmbus(psu->bus, psu->address, order);
-            if (order == 0)
-            {
-                configCR(true);
-                return;
-            }
+            targets.emplace_back(psu.bus, psu.address);
+        }
+    }
+
+    for (const auto& [bus, address] : targets)
+    {
+        // A PSU that reports rank 0 has lost its configuration (e.g. after
+        // AC cycle) so the ranks are rebuilt.
+        auto order = co_await pmbus.read(bus, address, pmbusCmdCRSupport);
+        if (order && *order == 0)
+        {
+            co_await configCR(true);
+            co_return;
         }
     }
 }
@@ -756,7 +1549,7 @@ void ColdRedundancy::startCRCheck()
         }
         if (crSupported)
         {
-            checkCR();
+            boost::asio::co_spawn(io, checkCR(), boost::asio::detached);
         }
         startCRCheck();
     });
@@ -764,67 +1557,176 @@ void ColdRedundancy::startCRCheck()
 
 // Rotate the orders of PSU redundancy. Each normal PSU will add one to its
 // rank order. And the PSU with last rank order will become the rank order 1
-void ColdRedundancy::rotateCR(void)
+boost::asio::awaitable<void> ColdRedundancy::rotateCR(void)
 {
-    if (!crSupported || !powerSupplyRedundancyEnabled() ||
-        coldRedundancyStatus() == Status::inProgress)
+    if (!crSupported || !powerSupplyRedundancyEnabled())
     {
-        return;
+        co_return;
+    }
+    if (coldRedundancyStatus() == Status::inProgress)
+    {
+        rotationPending = true;
+        co_return;
     }
     coldRedundancyStatus(Status::inProgress);
-    putWarmRedundant();
+    if (rotationMode == RotationMode::minimal)
+    {
+        co_await rotateMinimal();
+        finishTransition();
+        co_return;
+    }
 
-    warmRedundantTimer.expires_after(std::chrono::seconds(5));
-    warmRedundantTimer.async_wait([this](const boost::system::error_code& ec) {
-        if (ec == boost::asio::error::operation_aborted)
+    co_await putWarmRedundant();
+
+    if (!co_await waitWarmRedundant())
+    {
+        finishTransition();
+        co_return;
+    }
+
+    int goodPSUCount = 0;
+
+    for (auto& psu : powerSupplies)
+    {
+        if (psu.state == PSUState::normal)
         {
-            coldRedundancyStatus(Status::completed);
-            return;
+            goodPSUCount++;
         }
-        else if (ec)
+    }
+
+    std::vector<PmbusWrite> writes;
+    for (auto& psu : powerSupplies)
+    {
+        if (psu.order == 0)
         {
-            coldRedundancyStatus(Status::completed);
-            std::cerr << "warm redundant timer error\n";
-            return;
+            continue;
         }
-
-        int goodPSUCount = 0;
-
-        for (auto& psu : powerSupplies)
+        psu.order++;
+        if (psu.order > goodPSUCount)
         {
-            if (psu->state == PSUState::normal)
-            {
-                goodPSUCount++;
-            }
+            psu.order = 1;
         }
+        writes.push_back(
+            {psu.bus, psu.address, psu.order, psu.settleDelay});
+    }
 
-        for (auto& psu : powerSupplies)
+    std::vector<uint8_t> orders = {};
+    for (auto& psu : powerSupplies)
+    {
+        orders.push_back(psu.order);
+    }
+    rotationRankOrder(orders);
+    co_await writeRanks(std::move(writes));
+    finishTransition();
+}
+
+// Only the active role moves: the next ranked PSU after the rank 1 one in
+// registry order becomes rank 1, and the outgoing PSU takes the rank it
+// left. Every other standby PSU keeps its rank and is not written. Taking
+// the next PSU in registry order rather than rank 2 hands the active role
+// to each PSU in turn. The incoming PSU is held active for the warm hold
+// before the outgoing one goes to standby.
+boost::asio::awaitable<void> ColdRedundancy::rotateMinimal(void)
+{
+    std::vector<PowerSupply*> ranked;
+    std::optional<size_t> active;
+    for (auto& psu : powerSupplies)
+    {
+        if (psu.order == 0)
         {
-            if (psu->order == 0)
-            {
-                continue;
-            }
-            psu->order++;
-            if (psu->order > goodPSUCount)
-            {
-                psu->order = 1;
-            }
-            writePmbus(psu->bus, psu->address, psu->order);
+            continue;
         }
-
-        std::vector<uint8_t> orders = {};
-        for (auto& psu : powerSupplies)
+        if (psu.order == 1)
         {
-            orders.push_back(psu->order);
+            active = ranked.size();
         }
-        rotationRankOrder(orders);
-        coldRedundancyStatus(Status::completed);
-    });
+        ranked.push_back(&psu);
+    }
+    if (!active || ranked.size() < 2)
+    {
+        co_return;
+    }
+
+    PowerSupply& outgoing = *ranked[*active];
+    PowerSupply& incoming = *ranked[(*active + 1) % ranked.size()];
+    outgoing.order = incoming.order;
+    incoming.order = 1;
+    std::vector<PmbusWrite> incomingWrite = {
+        {incoming.bus, incoming.address, incoming.order, incoming.settleDelay}};
+    std::vector<PmbusWrite> outgoingWrite = {
+        {outgoing.bus, outgoing.address, outgoing.order, outgoing.settleDelay}};
+
+    std::vector<uint8_t> orders = {};
+    for (auto& psu : powerSupplies)
+    {
+        orders.push_back(psu.order);
+    }
+    rotationRankOrder(orders);
+
+    co_await writeRanks(std::move(incomingWrite));
+    if (!co_await waitWarmRedundant())
+    {
+        co_return;
+    }
+    co_await writeRanks(std::move(outgoingWrite));
 }
 
+// Wall clock readings before 2019 come from a clock that was never set, such
+// as a BMC without an RTC that booted at the epoch. It is read again until
+// time sync has set it.
+static constexpr const std::chrono::seconds wallClockFloor(1546300800);
+static constexpr const std::chrono::minutes wallClockRecheck(1);
+
+// Rotations follow a wall clock schedule, each one is due a period after the
+// previous deadline however often the timer is re-armed or the daemon is
+// restarted. The timer is armed once discovery has found the PSUs.
 void ColdRedundancy::startRotateCR()
 {
-    timerRotation.expires_after(std::chrono::seconds(periodOfRotation()));
+    auto now = PSUClock::wallNow();
+    if (now.time_since_epoch() < wallClockFloor)
+    {
+        // Keep the persisted schedule, it is only measured against a clock
+        // that has been set.
+        publishNextRotation();
+        if (discoveryDone)
+        {
+            timerRotation.expires_after(wallClockRecheck);
+            timerRotation.async_wait(
+                [this](const boost::system::error_code& ec) {
+                    if (ec != boost::asio::error::operation_aborted)
+                    {
+                        startRotateCR();
+                    }
+                });
+        }
+        return;
+    }
+    // No schedule yet, or the wall clock was set back past it.
+    if (lastRotation == std::chrono::system_clock::time_point() ||
+        lastRotation > now)
+    {
+        lastRotation = now;
+    }
+    if (!discoveryDone)
+    {
+        publishNextRotation();
+        return;
+    }
+    // Deadlines missed while the daemon was down, or left behind by a
+    // shorter period, are caught up with one rotation right away unless
+    // configured to be skipped.
+    if (lastRotation + rotationPeriod() <= now &&
+        rotationCatchUp == RotationCatchUp::skip)
+    {
+        alignRotation(now);
+        saveSnapshot();
+    }
+    publishNextRotation();
+
+    auto remaining = std::chrono::duration_cast<PSUClock::duration>(
+        lastRotation + rotationPeriod() - now);
+    timerRotation.expires_after(
+        std::max(remaining, PSUClock::duration::zero()));
     timerRotation.async_wait([this](const boost::system::error_code& ec) {
         if (ec == boost::asio::error::operation_aborted)
         {
@@ -834,197 +1736,342 @@ void ColdRedundancy::startRotateCR()
         {
             std::cerr << "timer error\n";
         }
+        auto now = PSUClock::wallNow();
+        // The wall clock lags the timer, e.g. after a time adjustment.
+        if (now < lastRotation + rotationPeriod())
+        {
+            startRotateCR();
+            return;
+        }
+        alignRotation(now);
         if (crSupported && rotationEnabled())
         {
-            rotateCR();
+            boost::asio::co_spawn(io, rotateCR(), boost::asio::detached);
+        }
+        else
+        {
+            saveSnapshot();
         }
         startRotateCR();
     });
 }
 
-void ColdRedundancy::putWarmRedundant(void)
+// A zero period would be due all the time, shorter periods are rejected
+// when configured.
+std::chrono::seconds ColdRedundancy::rotationPeriod(void)
+{
+    return std::chrono::seconds(
+        std::max<uint32_t>(periodOfRotation(), minRotationPeriod));
+}
+
+// Move the last rotation to the latest deadline that is not after now, so
+// the schedule keeps its phase across missed deadlines.
+void ColdRedundancy::alignRotation(std::chrono::system_clock::time_point now)
+{
+    auto period = rotationPeriod();
+    if (now >= lastRotation + period)
+    {
+        lastRotation += ((now - lastRotation) / period) * period;
+    }
+}
+
+void ColdRedundancy::publishNextRotation(void)
+{
+    uint64_t next = 0;
+    if (rotationEnabled() &&
+        lastRotation != std::chrono::system_clock::time_point())
+    {
+        next = std::chrono::duration_cast<std::chrono::microseconds>(
+                   (lastRotation + rotationPeriod()).time_since_epoch())
+                   .count();
+    }
+    rotationSchedule->set_property("NextRotationTime", next);
+}
+
+boost::asio::awaitable<void> ColdRedundancy::putWarmRedundant(void)
 {
     if (!crSupported)
     {
-        return;
+        co_return;
     }
+    std::vector<PmbusWrite> writes;
     for (auto& psu : powerSupplies)
     {
-        if (psu->state == PSUState::normal)
+        if (psu.state == PSUState::normal)
         {
-            writePmbus(psu->bus, psu->address, 0);
+            writes.push_back({psu.bus, psu.address, 0, psu.settleDelay});
         }
     }
+    co_await writeRanks(std::move(writes));
 }
 
-PowerSupply::~PowerSupply()
+// Hold every PSU warm for a while before the new ranks are written, returns
+// false if the wait was cancelled or a failover is waiting.
+boost::asio::awaitable<bool> ColdRedundancy::waitWarmRedundant(void)
 {
+    if (pendingFailover)
+    {
+        co_return false;
+    }
+    boost::system::error_code ec;
+    warmRedundantTimer.expires_after(warmRedundantHold);
+    co_await warmRedundantTimer.async_wait(
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec && ec != boost::asio::error::operation_aborted)
+    {
+        std::cerr << "warm redundant timer error\n";
+    }
+    co_return !ec;
 }
 
-void ColdRedundancy::writePmbus(uint8_t bus, uint8_t slaveAddr, uint8_t value)
+// Writes to PSUs on the same bus are issued in order. The I2C transfers are
+// blocking and run on the io thread, so buses are never written at the same
+// time; what each bus as its own coroutine buys is that the settle delay of
+// one PSU overlaps with the transfers on other buses. Without settle delays
+// there is nothing to overlap and the writes are issued one after another.
+// Returns once every bus has finished, or stopped early for a failover. The
+// writes are taken by value, powerSupplies may change while suspended.
+boost::asio::awaitable<void>
+    ColdRedundancy::writeRanks(std::vector<PmbusWrite> writes)
 {
-    int i = 0;
-    int tmpValue = -1;
+    boost::container::flat_map<uint8_t, std::vector<PmbusWrite>> lanes;
+    bool settles = false;
+    for (const auto& write : writes)
+    {
+        lanes[write.bus].push_back(write);
+        settles = settles || write.settleDelay.count() > 0;
+    }
+    if (lanes.size() <= 1 || !settles)
+    {
+        co_await writeBusRanks(std::move(writes));
+        co_return;
+    }
 
-    do
+    std::vector<boost::asio::awaitable<void>> tasks;
+    for (auto& lane : lanes)
     {
-        if (i > 0)
-        {
-            std::cerr << "i2cset retry: " + std::to_string(i) + "\n";
-        }
+        tasks.push_back(writeBusRanks(std::move(lane.second)));
+    }
+    co_await runConcurrently(std::move(tasks));
+}
 
-        if (i2cSet(bus, slaveAddr, pmbusCmdCRSupport, value))
-        {
-            std::cerr << "Failed to call i2cset\n";
-            continue;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        if (i2cGet(bus, slaveAddr, pmbusCmdCRSupport, tmpValue))
-        {
-            std::cerr << "Failed to call i2cget\n";
-            continue;
-        }
-    } while (i++ < retryCount && tmpValue != value);
+// Run the tasks as separate coroutines and resume once all have finished.
+boost::asio::awaitable<void> ColdRedundancy::runConcurrently(
+    std::vector<boost::asio::awaitable<void>> tasks)
+{
+    if (tasks.empty())
+    {
+        co_return;
+    }
+    auto pending = std::make_shared<size_t>(tasks.size());
+    auto allDone = std::make_shared<boost::asio::steady_timer>(
+        io, boost::asio::steady_timer::time_point::max());
+    for (auto& task : tasks)
+    {
+        boost::asio::co_spawn(io, std::move(task),
+                              [pending, allDone](std::exception_ptr) {
+                                  if (--(*pending) == 0)
+                                  {
+                                      allDone->cancel();
+                                  }
+                              });
+    }
+    boost::system::error_code ec;
+    co_await allDone->async_wait(
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
 }
 
-void ColdRedundancy::readPmbus(uint8_t bus, uint8_t slaveAddr, int& value)
+boost::asio::awaitable<void>
+    ColdRedundancy::writeBusRanks(std::vector<PmbusWrite> writes)
 {
-    int i = 0;
-    int ret = -1;
-    do
+    for (const auto& write : writes)
     {
-        ret = i2cGet(bus, slaveAddr, pmbusCmdCRSupport, value);
-        if (ret)
+        if (pendingFailover)
         {
-            std::cerr << "Failed to call i2cget, retry: " + std::to_string(i) +
-                             "\n";
+            co_return;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    } while (i++ < retryCount && ret);
+        co_await pmbus.write(write.bus, write.address, pmbusCmdCRSupport,
+                             write.value, write.settleDelay);
+    }
+}
+
+PowerSupply::~PowerSupply()
+{
 }
 
-void ColdRedundancy::checkRedundancyEvent()
+// Give every PSU its rank from RotationRankOrder, by position. Returns
+// whether any rank changed.
+bool ColdRedundancy::applyRankOrder(void)
+{
+    std::vector<uint8_t> orders = rotationRankOrder();
+    bool changed = false;
+    size_t index = 0;
+    for (auto& psu : powerSupplies)
+    {
+        uint8_t order = index < orders.size() ? orders[index] : 0;
+        changed = changed || psu.order != order;
+        psu.order = order;
+        index++;
+    }
+    return changed;
+}
+
+// One pass for everything signals marked dirty since the previous one.
+void ColdRedundancy::reconcile(Coalescer::Flags flags)
+{
+    if (flags & dirtyConfig)
+    {
+        timerRotation.cancel();
+        startRotateCR();
+        timerCheck.cancel();
+        startCRCheck();
+        saveConfig();
+    }
+    // The daemon's own rank order updates, from a failover or a rotation,
+    // come back as PropertiesChanged too. The PSUs already hold those ranks,
+    // so only an order that moves one of them is written.
+    bool rankOrderChanged = (flags & dirtyRankOrder) && applyRankOrder();
+    if (flags & dirtyRanks)
+    {
+        boost::asio::co_spawn(io, configCR(true), boost::asio::detached);
+    }
+    else if (rankOrderChanged)
+    {
+        boost::asio::co_spawn(io, configCR(false), boost::asio::detached);
+    }
+    if (flags & dirtyInventory)
+    {
+        // Redundancy is evaluated once the states are loaded.
+        loadPSUStates();
+    }
+    else if (flags & dirtyState)
+    {
+        evaluateRedundancy();
+    }
+    if (flags & (dirtyInventory | dirtyConfig))
+    {
+        saveSnapshot();
+    }
+}
+
+void ColdRedundancy::evaluateRedundancy()
 {
     if (!crSupported || !powerSupplyRedundancyEnabled())
     {
         return;
     }
-    puRedundantTimer.expires_after(std::chrono::seconds(2));
-    puRedundantTimer.async_wait([this](const boost::system::error_code& ec) {
-        if (ec == boost::asio::error::operation_aborted)
-        {
-            return;
-        }
-
-        uint8_t psuWorkable = 0;
-        static uint8_t psuPreviousWorkable = numberOfPSU;
+    uint8_t psuWorkable = 0;
+    if (!previousWorkable)
+    {
+        previousWorkable = numberOfPSU;
+    }
+    uint8_t psuPreviousWorkable = *previousWorkable;
 
-        for (const auto& psu : powerSupplies)
+    for (const auto& psu : powerSupplies)
+    {
+        if (psu.state == PSUState::normal)
         {
-            if (psu->state == PSUState::normal)
-            {
-                psuWorkable++;
-            }
+            psuWorkable++;
         }
+    }
 
-        if (psuWorkable > psuPreviousWorkable)
+    if (psuWorkable > psuPreviousWorkable)
+    {
+        if (psuWorkable >= redundantCount())
         {
-            if (psuWorkable >= redundantCount())
+            if (psuWorkable == numberOfPSU)
             {
-                if (psuWorkable == numberOfPSU)
-                {
-                    // When all PSU are work correctly, it is full redundant
-                    sd_journal_send(
-                        "MESSAGE=%s", "Power Unit Full Redundancy Regained",
-                        "PRIORITY=%i", LOG_INFO, "REDFISH_MESSAGE_ID=%s",
-                        "OpenBMC.0.1.PowerUnitRedundancyRegained", NULL);
-                    association->set_property("Associations", associationsOk);
-                }
-                else if (psuPreviousWorkable < redundantCount())
-                {
-                    // Not all PSU can work correctly but system still in
-                    // redundancy mode and previous status is non redundant
-                    sd_journal_send(
-                        "MESSAGE=%s",
-                        "Power Unit Redundancy Regained but not in Full "
-                        "Redundancy",
-                        "PRIORITY=%i", LOG_INFO, "REDFISH_MESSAGE_ID=%s",
-                        "OpenBMC.0.1.PowerUnitDegradedFromNonRedundant", NULL);
-                    association->set_property("Associations",
-                                              associationsWarning);
-                }
+                // When all PSU are work correctly, it is full redundant
+                sd_journal_send(
+                    "MESSAGE=%s", "Power Unit Full Redundancy Regained",
+                    "PRIORITY=%i", LOG_INFO, "REDFISH_MESSAGE_ID=%s",
+                    "OpenBMC.0.1.PowerUnitRedundancyRegained", NULL);
+                association->set_property("Associations", associationsOk);
             }
-            else if (psuPreviousWorkable == 0)
+            else if (psuPreviousWorkable < redundantCount())
             {
-                // Now system is not in redundancy mode but still some PSU are
-                // workable and previously there is no any workable PSU in the
-                // system
+                // Not all PSU can work correctly but system still in
+                // redundancy mode and previous status is non redundant
                 sd_journal_send(
                     "MESSAGE=%s",
-                    "Power Unit Redundancy Sufficient from insufficient",
+                    "Power Unit Redundancy Regained but not in Full "
+                    "Redundancy",
                     "PRIORITY=%i", LOG_INFO, "REDFISH_MESSAGE_ID=%s",
-                    "OpenBMC.0.1.PowerUnitNonRedundantFromInsufficient", NULL);
-                association->set_property("Associations", associationsNonCrit);
+                    "OpenBMC.0.1.PowerUnitDegradedFromNonRedundant", NULL);
+                association->set_property("Associations",
+                                          associationsWarning);
             }
         }
-        else if (psuWorkable < psuPreviousWorkable)
+        else if (psuPreviousWorkable == 0)
+        {
+            // Now system is not in redundancy mode but still some PSU are
+            // workable and previously there is no any workable PSU in the
+            // system
+            sd_journal_send(
+                "MESSAGE=%s",
+                "Power Unit Redundancy Sufficient from insufficient",
+                "PRIORITY=%i", LOG_INFO, "REDFISH_MESSAGE_ID=%s",
+                "OpenBMC.0.1.PowerUnitNonRedundantFromInsufficient", NULL);
+            association->set_property("Associations", associationsNonCrit);
+        }
+    }
+    else if (psuWorkable < psuPreviousWorkable)
+    {
+        if (psuWorkable >= redundantCount())
         {
-            if (psuWorkable >= redundantCount())
+            // One PSU is now not workable, but other workable PSU can still
+            // support redundancy mode.
+            sd_journal_send(
+                "MESSAGE=%s", "Power Unit Redundancy Degraded",
+                "PRIORITY=%i", LOG_WARNING, "REDFISH_MESSAGE_ID=%s",
+                "OpenBMC.0.1.PowerUnitRedundancyDegraded", NULL);
+            association->set_property("Associations", associationsWarning);
+
+            if (psuPreviousWorkable == numberOfPSU)
             {
-                // One PSU is now not workable, but other workable PSU can still
-                // support redundancy mode.
+                // One PSU become not workable and system was in full
+                // redundancy mode.
                 sd_journal_send(
-                    "MESSAGE=%s", "Power Unit Redundancy Degraded",
+                    "MESSAGE=%s",
+                    "Power Unit Redundancy Degraded from Full Redundant",
                     "PRIORITY=%i", LOG_WARNING, "REDFISH_MESSAGE_ID=%s",
-                    "OpenBMC.0.1.PowerUnitRedundancyDegraded", NULL);
-                association->set_property("Associations", associationsWarning);
-
-                if (psuPreviousWorkable == numberOfPSU)
+                    "OpenBMC.0.1.PowerUnitDegradedFromRedundant", NULL);
+            }
+        }
+        else
+        {
+            if (psuPreviousWorkable >= redundantCount())
+            {
+                // No enough workable PSU to support redundancy and
+                // previously system is in redundancy mode.
+                sd_journal_send(
+                    "MESSAGE=%s", "Power Unit Redundancy Lost",
+                    "PRIORITY=%i", LOG_WARNING, "REDFISH_MESSAGE_ID=%s",
+                    "OpenBMC.0.1.PowerUnitRedundancyLost", NULL);
+                if (psuWorkable > 0)
                 {
-                    // One PSU become not workable and system was in full
-                    // redundancy mode.
+                    // There still some workable PSU, but system is not
+                    // in redundancy mode.
                     sd_journal_send(
                         "MESSAGE=%s",
-                        "Power Unit Redundancy Degraded from Full Redundant",
+                        "Power Unit Redundancy NonRedundant Sufficient",
                         "PRIORITY=%i", LOG_WARNING, "REDFISH_MESSAGE_ID=%s",
-                        "OpenBMC.0.1.PowerUnitDegradedFromRedundant", NULL);
+                        "OpenBMC.0.1.PowerUnitNonRedundantSufficient",
+                        NULL);
+                    association->set_property("Associations",
+                                              associationsWarning);
                 }
             }
-            else
+            if (psuWorkable == 0)
             {
-                if (psuPreviousWorkable >= redundantCount())
-                {
-                    // No enough workable PSU to support redundancy and
-                    // previously system is in redundancy mode.
-                    sd_journal_send(
-                        "MESSAGE=%s", "Power Unit Redundancy Lost",
-                        "PRIORITY=%i", LOG_WARNING, "REDFISH_MESSAGE_ID=%s",
-                        "OpenBMC.0.1.PowerUnitRedundancyLost", NULL);
-                    if (psuWorkable > 0)
-                    {
-                        // There still some workable PSU, but system is not
-                        // in redundancy mode.
-                        sd_journal_send(
-                            "MESSAGE=%s",
-                            "Power Unit Redundancy NonRedundant Sufficient",
-                            "PRIORITY=%i", LOG_WARNING, "REDFISH_MESSAGE_ID=%s",
-                            "OpenBMC.0.1.PowerUnitNonRedundantSufficient",
-                            NULL);
-                        association->set_property("Associations",
-                                                  associationsWarning);
-                    }
-                }
-                if (psuWorkable == 0)
-                {
-                    // No any workable PSU on the system.
-                    sd_journal_send(
-                        "MESSAGE=%s", "Power Unit Redundancy Insufficient",
-                        "PRIORITY=%i", LOG_ERR, "REDFISH_MESSAGE_ID=%s",
-                        "OpenBMC.0.1.PowerUnitNonRedundantInsufficient", NULL);
-                    association->set_property("Associations", associationsCrit);
-                }
+                // No any workable PSU on the system.
+                sd_journal_send(
+                    "MESSAGE=%s", "Power Unit Redundancy Insufficient",
+                    "PRIORITY=%i", LOG_ERR, "REDFISH_MESSAGE_ID=%s",
+                    "OpenBMC.0.1.PowerUnitNonRedundantInsufficient", NULL);
+                association->set_property("Associations", associationsCrit);
             }
         }
-        psuPreviousWorkable = psuWorkable;
-    });
+    }
+    previousWorkable = psuWorkable;
 }
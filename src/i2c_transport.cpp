@@ -0,0 +1,363 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "i2c_transport.hpp"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <phosphor-logging/lg2.hpp>
+#include <string>
+
+extern "C" {
+#include <i2c/smbus.h>
+#include <linux/i2c-dev.h>
+}
+
+static std::unique_ptr<I2CTransport> transport;
+
+void setI2CTransport(std::unique_ptr<I2CTransport> newTransport)
+{
+    transport = std::move(newTransport);
+}
+
+I2CTransport& i2cTransport(void)
+{
+    if (!transport)
+    {
+        transport = std::make_unique<LinuxI2CTransport>();
+    }
+    return *transport;
+}
+
+LinuxI2CTransport::~LinuxI2CTransport()
+{
+    for (size_t bus = 0; bus < buses.size(); bus++)
+    {
+        closeBus(static_cast<uint8_t>(bus));
+    }
+}
+
+I2CBusHandle* LinuxI2CTransport::getBus(uint8_t bus)
+{
+    I2CBusHandle& handle = buses[bus];
+    if (handle.fd >= 0)
+    {
+        return &handle;
+    }
+
+    std::string devPath = "/dev/i2c-" + std::to_string(bus);
+    int fd = ::open(devPath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        lg2::error("Error in open!", "PATH", devPath.c_str());
+        return nullptr;
+    }
+
+    unsigned long funcs = 0;
+    if (::ioctl(fd, I2C_FUNCS, &funcs) < 0)
+    {
+        lg2::error("Error in I2C_FUNCS!", "PATH", devPath.c_str());
+        ::close(fd);
+        return nullptr;
+    }
+
+    handle.fd = fd;
+    handle.funcs = funcs;
+    handle.slaveAddr = -1;
+    return &handle;
+}
+
+void LinuxI2CTransport::closeBus(uint8_t bus)
+{
+    I2CBusHandle& handle = buses[bus];
+    if (handle.fd >= 0)
+    {
+        ::close(handle.fd);
+    }
+    handle = I2CBusHandle{};
+}
+
+// Drop the cached handle when the adapter behind it has gone away, e.g. a mux
+// channel was deleted, so the next access reopens the device node.
+void LinuxI2CTransport::checkBusError(uint8_t bus, int err)
+{
+    if (err == ENODEV || err == EBADF)
+    {
+        lg2::error("I2C adapter disappeared, dropping cached handle", "BUS",
+                   bus);
+        closeBus(bus);
+    }
+}
+
+int LinuxI2CTransport::selectSlave(I2CBusHandle* handle, uint8_t bus,
+                                   uint8_t slaveAddr)
+{
+    if (handle->slaveAddr == slaveAddr)
+    {
+        return 0;
+    }
+    if (::ioctl(handle->fd, I2C_SLAVE_FORCE, slaveAddr) < 0)
+    {
+        int err = errno;
+        lg2::error("Error in I2C_SLAVE_FORCE!", "BUS", bus, "SLAVEADDR",
+                   lg2::hex, slaveAddr);
+        checkBusError(bus, err);
+        return -err;
+    }
+    handle->slaveAddr = slaveAddr;
+    return 0;
+}
+
+int LinuxI2CTransport::set(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                           uint8_t value)
+{
+    I2CBusHandle* handle = getBus(bus);
+    if (handle == nullptr)
+    {
+        return -ENODEV;
+    }
+
+    if (!(handle->funcs & I2C_FUNC_SMBUS_WRITE_BYTE_DATA))
+    {
+        lg2::error("i2c bus does not support write!", "BUS", bus, "SLAVEADDR",
+                   lg2::hex, slaveAddr);
+        return -EOPNOTSUPP;
+    }
+
+    int selected = selectSlave(handle, bus, slaveAddr);
+    if (selected < 0)
+    {
+        return selected;
+    }
+
+    if (::i2c_smbus_write_byte_data(handle->fd, regAddr, value) < 0)
+    {
+        int err = errno;
+        lg2::error("Error in i2c write!", "BUS", bus, "SLAVEADDR", lg2::hex,
+                   slaveAddr);
+        checkBusError(bus, err);
+        return -err;
+    }
+
+    return 0;
+}
+
+bool LinuxI2CTransport::rdwrSupported(uint8_t bus)
+{
+    I2CBusHandle* handle = getBus(bus);
+    return handle != nullptr && (handle->funcs & I2C_FUNC_I2C);
+}
+
+int LinuxI2CTransport::setVerify(uint8_t bus, uint8_t slaveAddr,
+                                 uint8_t regAddr, uint8_t value, int& readback)
+{
+    I2CBusHandle* handle = getBus(bus);
+    if (handle == nullptr)
+    {
+        return -ENODEV;
+    }
+
+    if (!(handle->funcs & I2C_FUNC_I2C))
+    {
+        lg2::error("i2c bus does not support I2C_RDWR!", "BUS", bus,
+                   "SLAVEADDR", lg2::hex, slaveAddr);
+        return -EOPNOTSUPP;
+    }
+
+    // A PMBus device commits a Write Byte on STOP, so the write must end in
+    // one before the register is re-addressed and read back. Adapters that
+    // can mangle the protocol do it in one transaction with I2C_M_STOP,
+    // others in two.
+    uint8_t writeBuf[2] = {regAddr, value};
+    uint8_t readBuf = 0;
+    struct i2c_msg msgs[3] = {
+        {slaveAddr, 0, sizeof(writeBuf), writeBuf},
+        {slaveAddr, 0, 1, &regAddr},
+        {slaveAddr, I2C_M_RD, 1, &readBuf}};
+    struct i2c_rdwr_ioctl_data transfers[2] = {{msgs, 1}, {msgs + 1, 2}};
+    size_t count = 2;
+    if (handle->funcs & I2C_FUNC_PROTOCOL_MANGLING)
+    {
+        msgs[0].flags |= I2C_M_STOP;
+        transfers[0] = {msgs, 3};
+        count = 1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (::ioctl(handle->fd, I2C_RDWR, &transfers[i]) < 0)
+        {
+            int err = errno;
+            lg2::error("Error in I2C_RDWR!", "BUS", bus, "SLAVEADDR",
+                       lg2::hex, slaveAddr);
+            checkBusError(bus, err);
+            return -err;
+        }
+    }
+    readback = readBuf;
+    return 0;
+}
+
+std::optional<PresenceProbe>
+    LinuxI2CTransport::resolveProbe(uint8_t bus, PresenceProbe probe)
+{
+    I2CBusHandle* handle = getBus(bus);
+    if (handle == nullptr)
+    {
+        return std::nullopt;
+    }
+    if (probe == PresenceProbe::automatic)
+    {
+        probe = (handle->funcs & I2C_FUNC_SMBUS_QUICK)
+                    ? PresenceProbe::quickWrite
+                    : PresenceProbe::readByte;
+    }
+
+    unsigned long needed = 0;
+    switch (probe)
+    {
+        case PresenceProbe::quickWrite:
+            needed = I2C_FUNC_SMBUS_QUICK;
+            break;
+        case PresenceProbe::readRegister:
+            needed = I2C_FUNC_SMBUS_READ_BYTE_DATA;
+            break;
+        default:
+            needed = I2C_FUNC_SMBUS_READ_BYTE;
+            break;
+    }
+    if (!(handle->funcs & needed))
+    {
+        lg2::error("i2c bus does not support the presence probe", "BUS", bus,
+                   "PROBE", static_cast<int>(probe));
+        return std::nullopt;
+    }
+    return probe;
+}
+
+int LinuxI2CTransport::ping(uint8_t bus, uint8_t slaveAddr,
+                            PresenceProbe probe, uint8_t regAddr)
+{
+    I2CBusHandle* handle = getBus(bus);
+    if (handle == nullptr)
+    {
+        return -ENODEV;
+    }
+
+    int selected = selectSlave(handle, bus, slaveAddr);
+    if (selected < 0)
+    {
+        return selected;
+    }
+
+    int ret;
+    switch (probe)
+    {
+        case PresenceProbe::quickWrite:
+            ret = ::i2c_smbus_write_quick(handle->fd, I2C_SMBUS_WRITE);
+            break;
+        case PresenceProbe::readRegister:
+            ret = ::i2c_smbus_read_byte_data(handle->fd, regAddr);
+            break;
+        default:
+            ret = ::i2c_smbus_read_byte(handle->fd);
+            break;
+    }
+    // A missing PSU NACKs, that is expected and not logged.
+    if (ret < 0)
+    {
+        int err = errno;
+        checkBusError(bus, err);
+        return -err;
+    }
+
+    return 0;
+}
+
+int LinuxI2CTransport::get(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                           int& value)
+{
+    I2CBusHandle* handle = getBus(bus);
+    if (handle == nullptr)
+    {
+        return -ENODEV;
+    }
+
+    if (!(handle->funcs & I2C_FUNC_SMBUS_READ_BYTE_DATA))
+    {
+        lg2::error("i2c bus does not support read!", "BUS", bus, "SLAVEADDR",
+                   lg2::hex, slaveAddr);
+        return -EOPNOTSUPP;
+    }
+
+    int selected = selectSlave(handle, bus, slaveAddr);
+    if (selected < 0)
+    {
+        return selected;
+    }
+
+    value = ::i2c_smbus_read_byte_data(handle->fd, regAddr);
+    if (value < 0)
+    {
+        int err = errno;
+        lg2::error("Error in i2c read!", "BUS", bus, "SLAVEADDR", lg2::hex,
+                   slaveAddr);
+        checkBusError(bus, err);
+        return -err;
+    }
+    return 0;
+}
+
+// Performs i2c block read
+int LinuxI2CTransport::getBlock(uint8_t bus, uint8_t slaveAddr,
+                                uint8_t regAddr, int readLength,
+                                uint8_t* value)
+{
+    I2CBusHandle* handle = getBus(bus);
+    if (handle == nullptr)
+    {
+        return -ENODEV;
+    }
+
+    if (!(handle->funcs & I2C_FUNC_SMBUS_BLOCK_DATA) ||
+        !(handle->funcs & I2C_FUNC_SMBUS_I2C_BLOCK))
+    {
+        lg2::error("i2c bus does not support block read!", "BUS", bus,
+                   "SLAVEADDR", lg2::hex, slaveAddr);
+        return -EOPNOTSUPP;
+    }
+
+    int selected = selectSlave(handle, bus, slaveAddr);
+    if (selected < 0)
+    {
+        return selected;
+    }
+
+    int length = ::i2c_smbus_read_i2c_block_data(handle->fd, regAddr,
+                                                 readLength, value);
+    if (length <= 0)
+    {
+        int err = length < 0 ? errno : EIO;
+        lg2::error("Error in i2c read!", "BUS", bus, "SLAVEADDR", lg2::hex,
+                   slaveAddr);
+        checkBusError(bus, err);
+        return -err;
+    }
+    return length;
+}
@@ -0,0 +1,269 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "metrics.hpp"
+
+#include <cerrno>
+#include <sdbusplus/vtable.hpp>
+#include <tuple>
+
+static const std::array<const char*, static_cast<size_t>(I2COp::count)>
+    opNames = {"Set", "Get", "GetBlock", "SetVerify", "Ping"};
+
+I2CMetrics& i2cMetrics(void)
+{
+    static I2CMetrics metrics;
+    return metrics;
+}
+
+PresenceMetrics& presenceMetrics(void)
+{
+    static PresenceMetrics metrics;
+    return metrics;
+}
+
+ReconcileMetrics& reconcileMetrics(void)
+{
+    static ReconcileMetrics metrics;
+    return metrics;
+}
+
+FailoverMetrics& failoverMetrics(void)
+{
+    static FailoverMetrics metrics;
+    return metrics;
+}
+
+// Count, total and max latency in us, histogram.
+using HistogramEntry =
+    std::tuple<uint64_t, uint64_t, uint64_t, std::vector<uint64_t>>;
+
+static HistogramEntry histogramEntry(const LatencyHistogram& hist)
+{
+    return {hist.count, hist.totalUs, hist.maxUs,
+            std::vector<uint64_t>(hist.buckets.begin(), hist.buckets.end())};
+}
+
+static uint16_t deviceKey(uint8_t bus, uint8_t slaveAddr)
+{
+    return static_cast<uint16_t>((bus << 8) | slaveAddr);
+}
+
+I2CCounters* I2CMetrics::device(uint8_t bus, uint8_t slaveAddr)
+{
+    auto find = deviceIndex.find(deviceKey(bus, slaveAddr));
+    if (find == deviceIndex.end())
+    {
+        return nullptr;
+    }
+    return &devices[find->second].counters;
+}
+
+void I2CMetrics::registerDevice(uint8_t bus, uint8_t slaveAddr,
+                                const std::string& name)
+{
+    auto find = deviceIndex.find(deviceKey(bus, slaveAddr));
+    if (find != deviceIndex.end())
+    {
+        devices[find->second].name = name;
+        return;
+    }
+    deviceIndex.emplace(deviceKey(bus, slaveAddr), devices.size());
+    devices.push_back({name, bus, slaveAddr, {}});
+}
+
+void I2CMetrics::record(I2COp op, uint8_t bus, uint8_t slaveAddr,
+                        std::chrono::steady_clock::time_point start,
+                        int result)
+{
+    bool nack = result == -ENXIO || result == -EREMOTEIO;
+    bool failed = result < 0 && !(nack && op == I2COp::ping);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    size_t index = static_cast<size_t>(op);
+    histograms[index].record(latency);
+
+    I2CCounters* deviceCounters = device(bus, slaveAddr);
+    for (I2CCounters* counters : {&ops[index], &buses[bus], deviceCounters})
+    {
+        if (counters == nullptr)
+        {
+            continue;
+        }
+        counters->ops++;
+        if (nack)
+        {
+            counters->nacks++;
+        }
+        if (failed)
+        {
+            counters->failures++;
+        }
+    }
+}
+
+void I2CMetrics::recordRetry(uint8_t bus, uint8_t slaveAddr)
+{
+    buses[bus].retries++;
+    if (I2CCounters* counters = device(bus, slaveAddr))
+    {
+        counters->retries++;
+    }
+}
+
+void I2CMetrics::recordMismatch(uint8_t bus, uint8_t slaveAddr)
+{
+    buses[bus].readbackMismatches++;
+    if (I2CCounters* counters = device(bus, slaveAddr))
+    {
+        counters->readbackMismatches++;
+    }
+}
+
+void I2CMetrics::registerProperties(sdbusplus::asio::dbus_interface& iface)
+{
+    using OpEntry = std::tuple<std::string, uint64_t, uint64_t, uint64_t,
+                               uint64_t, uint64_t, std::vector<uint64_t>>;
+    using BusEntry = std::tuple<uint8_t, uint64_t, uint64_t, uint64_t,
+                                uint64_t, uint64_t>;
+    using DeviceEntry = std::tuple<std::string, uint8_t, uint8_t, uint64_t,
+                                   uint64_t, uint64_t, uint64_t, uint64_t>;
+
+    // Op name, count, failures, NACKs, total and max latency in us,
+    // histogram.
+    iface.register_property_r(
+        "Operations", std::vector<OpEntry>{},
+        sdbusplus::vtable::property_::none, [this](const auto&) {
+            std::vector<OpEntry> entries;
+            for (size_t index = 0; index < opNames.size(); index++)
+            {
+                const LatencyHistogram& hist = histograms[index];
+                entries.emplace_back(
+                    opNames[index], ops[index].ops, ops[index].failures,
+                    ops[index].nacks, hist.totalUs, hist.maxUs,
+                    std::vector<uint64_t>(hist.buckets.begin(),
+                                          hist.buckets.end()));
+            }
+            return entries;
+        });
+
+    // Bus, ops, failures, NACKs, retries, readback mismatches.
+    iface.register_property_r(
+        "Buses", std::vector<BusEntry>{}, sdbusplus::vtable::property_::none,
+        [this](const auto&) {
+            std::vector<BusEntry> entries;
+            for (size_t bus = 0; bus < buses.size(); bus++)
+            {
+                const I2CCounters& c = buses[bus];
+                if (c.ops == 0)
+                {
+                    continue;
+                }
+                entries.emplace_back(static_cast<uint8_t>(bus), c.ops,
+                                     c.failures, c.nacks, c.retries,
+                                     c.readbackMismatches);
+            }
+            return entries;
+        });
+
+    // PSU name, bus, address, ops, failures, NACKs, retries, readback
+    // mismatches.
+    iface.register_property_r(
+        "PowerSupplies", std::vector<DeviceEntry>{},
+        sdbusplus::vtable::property_::none, [this](const auto&) {
+            std::vector<DeviceEntry> entries;
+            for (const auto& d : devices)
+            {
+                entries.emplace_back(d.name, d.bus, d.address, d.counters.ops,
+                                     d.counters.failures, d.counters.nacks,
+                                     d.counters.retries,
+                                     d.counters.readbackMismatches);
+            }
+            return entries;
+        });
+}
+
+void PresenceMetrics::registerProperties(sdbusplus::asio::dbus_interface& iface)
+{
+    constexpr auto none = sdbusplus::vtable::property_::none;
+    iface.register_property_r("PresenceScans", uint64_t(0), none,
+                              [this](const auto&) { return scans; });
+    iface.register_property_r("PresenceChanges", uint64_t(0), none,
+                              [this](const auto&) { return changes; });
+    iface.register_property_r("PresenceHints", uint64_t(0), none,
+                              [this](const auto&) { return hints; });
+    iface.register_property_r("PresencePollIntervalMs", uint64_t(0), none,
+                              [this](const auto&) { return pollIntervalMs; });
+    iface.register_property_r(
+        "PresenceScanCost", HistogramEntry{}, none,
+        [this](const auto&) { return histogramEntry(scanCost); });
+    iface.register_property_r(
+        "PresenceDetectionLatency", HistogramEntry{}, none,
+        [this](const auto&) { return histogramEntry(detectionLatency); });
+}
+
+void ReconcileMetrics::registerProperties(
+    sdbusplus::asio::dbus_interface& iface)
+{
+    constexpr auto none = sdbusplus::vtable::property_::none;
+    iface.register_property_r("ReconcileEvents", uint64_t(0), none,
+                              [this](const auto&) { return events; });
+    iface.register_property_r("ReconcilePasses", uint64_t(0), none,
+                              [this](const auto&) { return passes; });
+    // Events that did not need a pass of their own.
+    iface.register_property_r("MergedEvents", uint64_t(0), none,
+                              [this](const auto&) {
+                                  return events > passes ? events - passes
+                                                         : uint64_t(0);
+                              });
+}
+
+void FailoverMetrics::registerProperties(sdbusplus::asio::dbus_interface& iface)
+{
+    constexpr auto none = sdbusplus::vtable::property_::none;
+    iface.register_property_r("Failovers", uint64_t(0), none,
+                              [this](const auto&) { return failovers; });
+    iface.register_property_r("FailoversDeferred", uint64_t(0), none,
+                              [this](const auto&) { return deferred; });
+    iface.register_property_r(
+        "FailoverWakeLatency", HistogramEntry{}, none,
+        [this](const auto&) { return histogramEntry(wakeLatency); });
+    iface.register_property_r(
+        "FailoverLatency", HistogramEntry{}, none,
+        [this](const auto&) { return histogramEntry(failoverLatency); });
+}
+
+std::shared_ptr<sdbusplus::asio::dbus_interface>
+    addMetricsInterface(sdbusplus::asio::object_server& objectServer,
+                        const std::string& path)
+{
+    auto iface = objectServer.add_interface(path, metricsInterfaceName);
+
+    std::vector<uint64_t> bounds;
+    for (size_t bucket = 0; bucket < LatencyHistogram::bucketCount - 1;
+         bucket++)
+    {
+        bounds.push_back(uint64_t(1) << bucket);
+    }
+    iface->register_property("LatencyBucketBoundsUs", bounds);
+    i2cMetrics().registerProperties(*iface);
+    presenceMetrics().registerProperties(*iface);
+    reconcileMetrics().registerProperties(*iface);
+    failoverMetrics().registerProperties(*iface);
+
+    iface->initialize();
+    return iface;
+}
@@ -0,0 +1,131 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "pmbus.hpp"
+
+#include "metrics.hpp"
+#include "utility.hpp"
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <iostream>
+
+static constexpr const int retryCount = 3;
+static constexpr const std::chrono::milliseconds readRetryDelay(100);
+
+Pmbus::Pmbus(boost::asio::io_service& io) : io(io)
+{
+}
+
+boost::asio::awaitable<bool>
+    Pmbus::sleep(std::chrono::milliseconds duration)
+{
+    PSUTimer timer(io, duration);
+    pendingTimers.insert(&timer);
+    boost::system::error_code ec;
+    co_await timer.async_wait(
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    pendingTimers.erase(&timer);
+    co_return !ec;
+}
+
+void Pmbus::cancel(void)
+{
+    for (auto timer : pendingTimers)
+    {
+        timer->cancel();
+    }
+}
+
+boost::asio::awaitable<bool>
+    Pmbus::write(uint8_t bus, uint8_t slaveAddr, uint8_t cmd, uint8_t value,
+                 std::chrono::milliseconds settleDelay)
+{
+    bool combined = settleDelay.count() == 0 && i2cRdwrSupported(bus);
+    for (int retry = 0; retry <= retryCount; retry++)
+    {
+        if (retry > 0)
+        {
+            std::cerr << "i2cset retry: " + std::to_string(retry) + "\n";
+            i2cMetrics().recordRetry(bus, slaveAddr);
+        }
+
+        int tmpValue = -1;
+        if (combined)
+        {
+            if (i2cSetVerify(bus, slaveAddr, cmd, value, tmpValue))
+            {
+                std::cerr << "Failed to call i2c rdwr\n";
+                continue;
+            }
+        }
+        else
+        {
+            if (i2cSet(bus, slaveAddr, cmd, value))
+            {
+                std::cerr << "Failed to call i2cset\n";
+                continue;
+            }
+            if (settleDelay.count() > 0 && !co_await sleep(settleDelay))
+            {
+                co_return false;
+            }
+            if (i2cGet(bus, slaveAddr, cmd, tmpValue))
+            {
+                std::cerr << "Failed to call i2cget\n";
+                continue;
+            }
+        }
+        if (tmpValue == value)
+        {
+            co_return true;
+        }
+        i2cMetrics().recordMismatch(bus, slaveAddr);
+    }
+    co_return false;
+}
+
+boost::asio::awaitable<std::optional<int>>
+    Pmbus::read(uint8_t bus, uint8_t slaveAddr, uint8_t cmd)
+{
+    for (int retry = 0; retry <= retryCount; retry++)
+    {
+        int value = -1;
+        if (i2cGet(bus, slaveAddr, cmd, value) == 0)
+        {
+            co_return value;
+        }
+        std::cerr << "Failed to call i2cget, retry: " + std::to_string(retry) +
+                         "\n";
+        if (retry == retryCount)
+        {
+            break;
+        }
+        i2cMetrics().recordRetry(bus, slaveAddr);
+        if (!co_await sleep(readRetryDelay))
+        {
+            break;
+        }
+    }
+    co_return std::nullopt;
+}
+
+boost::asio::awaitable<int> Pmbus::readBlock(uint8_t bus, uint8_t slaveAddr,
+                                             uint8_t cmd, int readLength,
+                                             uint8_t* value)
+{
+    co_return i2cGet(bus, slaveAddr, cmd, readLength, value);
+}
@@ -0,0 +1,93 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "psu_clock.hpp"
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+// The daemon is single threaded, the clock state needs no locking.
+static std::optional<PSUClock::time_point> virtualNow;
+// Both clocks as read when virtual time started.
+static PSUClock::time_point virtualStart;
+static std::chrono::system_clock::time_point wallStart;
+// Expiries only matter under virtual time, they are not kept otherwise.
+static std::priority_queue<PSUClock::time_point,
+                           std::vector<PSUClock::time_point>,
+                           std::greater<PSUClock::time_point>>
+    expiries;
+
+PSUClock::time_point PSUClock::now() noexcept
+{
+    if (virtualNow)
+    {
+        return *virtualNow;
+    }
+    return time_point(std::chrono::steady_clock::now().time_since_epoch());
+}
+
+void PSUClock::useVirtualTime(void)
+{
+    virtualNow = now();
+    virtualStart = *virtualNow;
+    wallStart = std::chrono::system_clock::now();
+}
+
+bool PSUClock::isVirtual(void)
+{
+    return virtualNow.has_value();
+}
+
+void PSUClock::advanceTo(time_point when)
+{
+    if (virtualNow && when > *virtualNow)
+    {
+        virtualNow = when;
+    }
+}
+
+std::optional<PSUClock::time_point> PSUClock::nextExpiry(void)
+{
+    while (!expiries.empty() && expiries.top() <= now())
+    {
+        expiries.pop();
+    }
+    if (expiries.empty())
+    {
+        return std::nullopt;
+    }
+    return expiries.top();
+}
+
+std::chrono::system_clock::time_point PSUClock::wallNow(void)
+{
+    if (virtualNow)
+    {
+        return wallStart +
+               std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                   *virtualNow - virtualStart);
+    }
+    return std::chrono::system_clock::now();
+}
+
+void PSUClock::schedule(time_point expiry)
+{
+    if (virtualNow && expiry != time_point::max())
+    {
+        expiries.push(expiry);
+    }
+}
@@ -0,0 +1,152 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "psu_registry.hpp"
+
+#include <algorithm>
+
+std::optional<PSUHandle> PSURegistry::insert(PowerSupply&& psu)
+{
+    if (byName.contains(psu.name) ||
+        byAddress.contains(addressKey(psu.bus, psu.address)) ||
+        (!psu.configPath.empty() && byConfigPath.contains(psu.configPath)))
+    {
+        return std::nullopt;
+    }
+
+    uint32_t slot;
+    if (freeSlots.empty())
+    {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    else
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+
+    byName.emplace(psu.name, slot);
+    byAddress.emplace(addressKey(psu.bus, psu.address), slot);
+    if (!psu.configPath.empty())
+    {
+        byConfigPath.emplace(psu.configPath, slot);
+    }
+    slots[slot].psu.emplace(std::move(psu));
+    order.push_back(slot);
+    return PSUHandle{slot, slots[slot].generation};
+}
+
+bool PSURegistry::remove(PSUHandle handle)
+{
+    if (!valid(handle))
+    {
+        return false;
+    }
+    Slot& entry = slots[handle.slot];
+    byName.erase(entry.psu->name);
+    byAddress.erase(addressKey(entry.psu->bus, entry.psu->address));
+    byConfigPath.erase(entry.psu->configPath);
+    order.erase(std::find(order.begin(), order.end(), handle.slot));
+    entry.psu.reset();
+    entry.generation++;
+    freeSlots.push_back(handle.slot);
+    return true;
+}
+
+bool PSURegistry::rekey(PSUHandle handle, const std::string& name,
+                        uint8_t bus, uint8_t address)
+{
+    if (!valid(handle))
+    {
+        return false;
+    }
+    PowerSupply& psu = *slots[handle.slot].psu;
+    auto nameOwner = byName.find(name);
+    auto addressOwner = byAddress.find(addressKey(bus, address));
+    if ((nameOwner != byName.end() && nameOwner->second != handle.slot) ||
+        (addressOwner != byAddress.end() &&
+         addressOwner->second != handle.slot))
+    {
+        return false;
+    }
+
+    byName.erase(psu.name);
+    byAddress.erase(addressKey(psu.bus, psu.address));
+    psu.name = name;
+    psu.bus = bus;
+    psu.address = address;
+    byName.emplace(psu.name, handle.slot);
+    byAddress.emplace(addressKey(psu.bus, psu.address), handle.slot);
+    return true;
+}
+
+PowerSupply* PSURegistry::get(PSUHandle handle)
+{
+    if (!valid(handle))
+    {
+        return nullptr;
+    }
+    return &*slots[handle.slot].psu;
+}
+
+std::optional<PSUHandle> PSURegistry::findByName(std::string_view name) const
+{
+    auto find = byName.find(name);
+    if (find == byName.end())
+    {
+        return std::nullopt;
+    }
+    return PSUHandle{find->second, slots[find->second].generation};
+}
+
+std::optional<PSUHandle> PSURegistry::findByAddress(uint8_t bus,
+                                                    uint8_t address) const
+{
+    auto find = byAddress.find(addressKey(bus, address));
+    if (find == byAddress.end())
+    {
+        return std::nullopt;
+    }
+    return PSUHandle{find->second, slots[find->second].generation};
+}
+
+std::optional<PSUHandle>
+    PSURegistry::findByConfigPath(std::string_view path) const
+{
+    auto find = byConfigPath.find(path);
+    if (find == byConfigPath.end())
+    {
+        return std::nullopt;
+    }
+    return PSUHandle{find->second, slots[find->second].generation};
+}
+
+std::optional<size_t> PSURegistry::position(PSUHandle handle) const
+{
+    if (!valid(handle))
+    {
+        return std::nullopt;
+    }
+    return std::distance(order.begin(),
+                         std::find(order.begin(), order.end(), handle.slot));
+}
+
+bool PSURegistry::valid(PSUHandle handle) const
+{
+    return handle.slot < slots.size() && slots[handle.slot].psu &&
+           slots[handle.slot].generation == handle.generation;
+}
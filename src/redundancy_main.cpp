@@ -28,6 +28,7 @@ int main(int argc, char** argv)
     sdbusplus::asio::object_server objectServer(systemBus);
 
     ColdRedundancy coldRedundancy(io, objectServer, systemBus, matches);
+    io.run();
 
     return 0;
 }
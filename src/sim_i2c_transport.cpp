@@ -0,0 +1,198 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "sim_i2c_transport.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+static uint16_t simKey(uint8_t bus, uint8_t address)
+{
+    return static_cast<uint16_t>((bus << 8) | address);
+}
+
+SimulatedI2CTransport::SimulatedI2CTransport(uint32_t seed) : rng(seed)
+{
+}
+
+SimPSU& SimulatedI2CTransport::addPSU(uint8_t bus, uint8_t address)
+{
+    return psus[simKey(bus, address)];
+}
+
+void SimulatedI2CTransport::removePSU(uint8_t bus, uint8_t address)
+{
+    psus.erase(simKey(bus, address));
+}
+
+SimPSU* SimulatedI2CTransport::psu(uint8_t bus, uint8_t address)
+{
+    auto find = psus.find(simKey(bus, address));
+    if (find == psus.end())
+    {
+        return nullptr;
+    }
+    return &find->second;
+}
+
+void SimulatedI2CTransport::setLatency(std::chrono::microseconds latency)
+{
+    defaultLatency = latency;
+}
+
+void SimulatedI2CTransport::setNackRate(double rate)
+{
+    defaultNackRate = rate;
+}
+
+void SimulatedI2CTransport::setRdwrSupported(bool supported)
+{
+    rdwr = supported;
+}
+
+void SimulatedI2CTransport::setQuickSupported(bool supported)
+{
+    quick = supported;
+}
+
+SimPSU* SimulatedI2CTransport::transfer(uint8_t bus, uint8_t slaveAddr)
+{
+    transactionCount++;
+    SimPSU* target = psu(bus, slaveAddr);
+
+    std::chrono::microseconds latency = defaultLatency;
+    double nackRate = defaultNackRate;
+    if (target != nullptr)
+    {
+        if (target->latency.count() >= 0)
+        {
+            latency = target->latency;
+        }
+        if (target->nackRate >= 0.0)
+        {
+            nackRate = target->nackRate;
+        }
+    }
+    if (latency.count() > 0)
+    {
+        std::this_thread::sleep_for(latency);
+    }
+
+    if (target == nullptr || !target->present)
+    {
+        nackCount++;
+        return nullptr;
+    }
+    if (nackRate > 0.0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(rng) < nackRate)
+    {
+        nackCount++;
+        return nullptr;
+    }
+    return target;
+}
+
+int SimulatedI2CTransport::set(uint8_t bus, uint8_t slaveAddr,
+                               uint8_t regAddr, uint8_t value)
+{
+    SimPSU* target = transfer(bus, slaveAddr);
+    if (target == nullptr)
+    {
+        return -ENXIO;
+    }
+    target->write(regAddr, value);
+    return 0;
+}
+
+int SimulatedI2CTransport::get(uint8_t bus, uint8_t slaveAddr,
+                               uint8_t regAddr, int& value)
+{
+    SimPSU* target = transfer(bus, slaveAddr);
+    if (target == nullptr)
+    {
+        return -ENXIO;
+    }
+    value = target->registers[regAddr];
+    return 0;
+}
+
+int SimulatedI2CTransport::getBlock(uint8_t bus, uint8_t slaveAddr,
+                                    uint8_t regAddr, int readLength,
+                                    uint8_t* value)
+{
+    if (readLength <= 0)
+    {
+        return -EINVAL;
+    }
+    SimPSU* target = transfer(bus, slaveAddr);
+    if (target == nullptr)
+    {
+        return -ENXIO;
+    }
+    if (regAddr != 0xD9)
+    {
+        std::fill_n(value, readLength, target->registers[regAddr]);
+        return readLength;
+    }
+    int length =
+        std::min(readLength, static_cast<int>(target->revision.size()));
+    std::copy_n(target->revision.begin(), length, value);
+    return length;
+}
+
+int SimulatedI2CTransport::setVerify(uint8_t bus, uint8_t slaveAddr,
+                                     uint8_t regAddr, uint8_t value,
+                                     int& readback)
+{
+    if (!rdwr)
+    {
+        return -EOPNOTSUPP;
+    }
+    SimPSU* target = transfer(bus, slaveAddr);
+    if (target == nullptr)
+    {
+        return -ENXIO;
+    }
+    target->write(regAddr, value);
+    readback = target->registers[regAddr];
+    return 0;
+}
+
+bool SimulatedI2CTransport::rdwrSupported(uint8_t)
+{
+    return rdwr;
+}
+
+std::optional<PresenceProbe>
+    SimulatedI2CTransport::resolveProbe(uint8_t, PresenceProbe probe)
+{
+    if (probe == PresenceProbe::automatic)
+    {
+        return quick ? PresenceProbe::quickWrite : PresenceProbe::readByte;
+    }
+    if (probe == PresenceProbe::quickWrite && !quick)
+    {
+        return std::nullopt;
+    }
+    return probe;
+}
+
+int SimulatedI2CTransport::ping(uint8_t bus, uint8_t slaveAddr, PresenceProbe,
+                                uint8_t)
+{
+    return transfer(bus, slaveAddr) == nullptr ? -ENXIO : 0;
+}
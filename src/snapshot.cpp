@@ -0,0 +1,307 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+static constexpr uint32_t snapshotMagic = 0x52555350; // "PSUR"
+static constexpr uint16_t snapshotVersion = 1;
+
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t bodySize;
+    uint32_t checksum;
+};
+
+// FNV-1a, enough to reject a torn or foreign file.
+static uint32_t checksum(const uint8_t* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+static void put(std::vector<uint8_t>& image, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    image.insert(image.end(), bytes, bytes + sizeof(T));
+}
+
+static void putBytes(std::vector<uint8_t>& image, const void* data,
+                     size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    image.insert(image.end(), bytes, bytes + size);
+}
+
+static void putString(std::vector<uint8_t>& image, const std::string& value)
+{
+    put(image, static_cast<uint16_t>(value.size()));
+    putBytes(image, value.data(), value.size());
+}
+
+// Bounds checked reads from the mapped body.
+class SnapshotReader
+{
+  public:
+    SnapshotReader(const uint8_t* data, size_t size) : data(data), size(size)
+    {
+    }
+
+    template <typename T>
+    bool get(T& value)
+    {
+        if (size - offset < sizeof(T))
+        {
+            return false;
+        }
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    bool getBytes(void* value, size_t length)
+    {
+        if (size - offset < length)
+        {
+            return false;
+        }
+        std::memcpy(value, data + offset, length);
+        offset += length;
+        return true;
+    }
+
+    bool getString(std::string& value)
+    {
+        uint16_t length = 0;
+        if (!get(length) || size - offset < length)
+        {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(data + offset), length);
+        offset += length;
+        return true;
+    }
+
+    bool done() const
+    {
+        return offset == size;
+    }
+
+  private:
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+};
+
+std::vector<uint8_t> encodeSnapshot(const Snapshot& snapshot)
+{
+    std::vector<uint8_t> image(sizeof(SnapshotHeader));
+    put(image, static_cast<uint8_t>(snapshot.redundancyEnabled));
+    put(image, static_cast<uint8_t>(snapshot.rotationEnabled));
+    putString(image, snapshot.algorithm);
+    put(image, snapshot.periodOfRotation);
+    put(image, static_cast<int64_t>(
+                   std::chrono::duration_cast<std::chrono::seconds>(
+                       snapshot.nextRotation.time_since_epoch())
+                       .count()));
+    put(image, static_cast<uint16_t>(snapshot.rankOrder.size()));
+    putBytes(image, snapshot.rankOrder.data(), snapshot.rankOrder.size());
+    put(image, static_cast<uint16_t>(snapshot.psus.size()));
+    for (const auto& psu : snapshot.psus)
+    {
+        put(image, psu.bus);
+        put(image, psu.address);
+        put(image, psu.order);
+        putString(image, psu.name);
+        putString(image, psu.configPath);
+    }
+
+    SnapshotHeader header = {};
+    header.magic = snapshotMagic;
+    header.version = snapshotVersion;
+    header.bodySize = static_cast<uint32_t>(image.size() - sizeof(header));
+    header.checksum =
+        checksum(image.data() + sizeof(header), image.size() - sizeof(header));
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+static std::optional<Snapshot> decodeSnapshot(const uint8_t* data,
+                                              size_t size)
+{
+    SnapshotHeader header;
+    if (size < sizeof(header))
+    {
+        return std::nullopt;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    const uint8_t* body = data + sizeof(header);
+    if (header.magic != snapshotMagic || header.version != snapshotVersion ||
+        header.bodySize != size - sizeof(header) ||
+        header.checksum != checksum(body, header.bodySize))
+    {
+        return std::nullopt;
+    }
+
+    SnapshotReader reader(body, header.bodySize);
+    Snapshot snapshot;
+    uint8_t redundancyEnabled = 0;
+    uint8_t rotationEnabled = 0;
+    int64_t nextRotation = 0;
+    uint16_t rankCount = 0;
+    if (!reader.get(redundancyEnabled) || !reader.get(rotationEnabled) ||
+        !reader.getString(snapshot.algorithm) ||
+        !reader.get(snapshot.periodOfRotation) || !reader.get(nextRotation) ||
+        !reader.get(rankCount))
+    {
+        return std::nullopt;
+    }
+    snapshot.redundancyEnabled = redundancyEnabled != 0;
+    snapshot.rotationEnabled = rotationEnabled != 0;
+    snapshot.nextRotation = std::chrono::system_clock::time_point(
+        std::chrono::seconds(nextRotation));
+    snapshot.rankOrder.resize(rankCount);
+    uint16_t psuCount = 0;
+    if (!reader.getBytes(snapshot.rankOrder.data(), rankCount) ||
+        !reader.get(psuCount))
+    {
+        return std::nullopt;
+    }
+    snapshot.psus.resize(psuCount);
+    for (auto& psu : snapshot.psus)
+    {
+        if (!reader.get(psu.bus) || !reader.get(psu.address) ||
+            !reader.get(psu.order) || !reader.getString(psu.name) ||
+            !reader.getString(psu.configPath))
+        {
+            return std::nullopt;
+        }
+    }
+    if (!reader.done())
+    {
+        return std::nullopt;
+    }
+    return snapshot;
+}
+
+std::optional<Snapshot> readSnapshot(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+    struct stat status;
+    if (::fstat(fd, &status) < 0 || status.st_size <= 0)
+    {
+        ::close(fd);
+        return std::nullopt;
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Failed to map snapshot " << path << "\n";
+        return std::nullopt;
+    }
+    std::optional<Snapshot> snapshot =
+        decodeSnapshot(static_cast<const uint8_t*>(map), size);
+    ::munmap(map, size);
+    if (!snapshot)
+    {
+        std::cerr << "Ignoring invalid snapshot " << path << "\n";
+    }
+    return snapshot;
+}
+
+bool writeSnapshot(const std::string& path, const std::vector<uint8_t>& image)
+{
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+    if (dir.empty())
+    {
+        dir = ".";
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to create snapshot " << tmpPath << "\n";
+        return false;
+    }
+    size_t written = 0;
+    while (written < image.size())
+    {
+        ssize_t n = ::write(fd, image.data() + written, image.size() - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    if (written != image.size() || ::fsync(fd) < 0)
+    {
+        std::cerr << "Failed to write snapshot " << tmpPath << "\n";
+        ::close(fd);
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    ::close(fd);
+    if (::rename(tmpPath.c_str(), path.c_str()) < 0)
+    {
+        std::cerr << "Failed to replace snapshot " << path << "\n";
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    // The rename only survives a power loss once the directory is synced.
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0 || ::fsync(dirFd) < 0)
+    {
+        std::cerr << "Failed to sync snapshot directory " << dir << "\n";
+        if (dirFd >= 0)
+        {
+            ::close(dirFd);
+        }
+        return false;
+    }
+    ::close(dirFd);
+    return true;
+}
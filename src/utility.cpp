@@ -16,317 +16,310 @@
 
 #include "utility.hpp"
 
+#include "i2c_transport.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
 #include <boost/algorithm/string/predicate.hpp>
+#include <cerrno>
 #include <phosphor-logging/elog-errors.hpp>
 
-extern "C" {
-#include <i2c/smbus.h>
-#include <linux/i2c-dev.h>
-}
-
 int i2cSet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, uint8_t value)
 {
-    unsigned long funcs = 0;
-    std::string devPath = "/dev/i2c-" + std::to_string(bus);
-
-    int fd = ::open(devPath.c_str(), O_RDWR);
-    if (fd < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in open!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        return -1;
-    }
-
-    if (::ioctl(fd, I2C_FUNCS, &funcs) < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in I2C_FUNCS!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
-    }
-
-    if (!(funcs & I2C_FUNC_SMBUS_WRITE_BYTE_DATA))
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "i2c bus does not support write!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
-    }
-
-    if (::ioctl(fd, I2C_SLAVE_FORCE, slaveAddr) < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in I2C_SLAVE_FORCE!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
-    }
-
-    if (::i2c_smbus_write_byte_data(fd, regAddr, value) < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in i2c write!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
-    }
+    auto start = std::chrono::steady_clock::now();
+    int ret = i2cTransport().set(bus, slaveAddr, regAddr, value);
+    i2cMetrics().record(I2COp::set, bus, slaveAddr, start, ret);
+    return ret;
+}
 
-    ::close(fd);
-    return 0;
+int i2cSetVerify(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr,
+                 uint8_t value, int& readback)
+{
+    auto start = std::chrono::steady_clock::now();
+    int ret =
+        i2cTransport().setVerify(bus, slaveAddr, regAddr, value, readback);
+    i2cMetrics().record(I2COp::setVerify, bus, slaveAddr, start, ret);
+    return ret;
 }
 
-int setPingFd(int& fd, uint64_t bus)
+bool i2cRdwrSupported(uint8_t bus)
 {
-    if (fd > 0)
-    {
-        ::close(fd);
-    }
-    std::string pingPath = "/dev/i2c-" + std::to_string(bus);
-    fd = ::open(pingPath.c_str(), O_RDWR | O_CLOEXEC);
-    if (fd < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in open!",
-            phosphor::logging::entry("PATH=%s", pingPath.c_str()));
-        return -1;
-    }
+    return i2cTransport().rdwrSupported(bus);
+}
 
-    unsigned long funcs = 0;
-    if (::ioctl(fd, I2C_FUNCS, &funcs) < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in I2C_FUNCS!",
-            phosphor::logging::entry("PATH=%s", pingPath.c_str()));
-        ::close(fd);
-        return -1;
-    }
+std::optional<PresenceProbe> i2cResolveProbe(uint8_t bus,
+                                             PresenceProbe probe)
+{
+    return i2cTransport().resolveProbe(bus, probe);
+}
 
-    if (!(funcs & I2C_FUNC_SMBUS_READ_BYTE))
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "i2c bus does not support read!",
-            phosphor::logging::entry("PATH=%s", pingPath.c_str()));
-        ::close(fd);
-        return -1;
-    }
-    return 0;
+int i2cPing(uint8_t bus, uint8_t slaveAddr, PresenceProbe probe,
+            uint8_t regAddr)
+{
+    auto start = std::chrono::steady_clock::now();
+    int ret = i2cTransport().ping(bus, slaveAddr, probe, regAddr);
+    i2cMetrics().record(I2COp::ping, bus, slaveAddr, start, ret);
+    return ret;
 }
 
-int i2cPing(int fd, uint8_t slaveAddr)
+int i2cGet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, int& value)
 {
-    if (::ioctl(fd, I2C_SLAVE_FORCE, slaveAddr) < 0)
-    {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in I2C_SLAVE_FORCE!",
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
-    }
+    auto start = std::chrono::steady_clock::now();
+    int ret = i2cTransport().get(bus, slaveAddr, regAddr, value);
+    i2cMetrics().record(I2COp::get, bus, slaveAddr, start, ret);
+    return ret;
+}
 
-    if (::i2c_smbus_read_byte(fd) < 0)
+// Performs i2c block read
+int i2cGet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, int readLength,
+           uint8_t* value)
+{
+    if (value == nullptr)
     {
-        return -1;
+        lg2::error("i2cGet passed nullptr value array!");
+        return -EINVAL;
     }
-
-    return 0;
+    auto start = std::chrono::steady_clock::now();
+    int ret =
+        i2cTransport().getBlock(bus, slaveAddr, regAddr, readLength, value);
+    i2cMetrics().record(I2COp::getBlock, bus, slaveAddr, start, ret);
+    return ret;
 }
 
-int i2cGet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, int& value)
+std::optional<std::string_view> psuNameFromStatePath(std::string_view path)
 {
-    unsigned long funcs = 0;
-    std::string devPath = "/dev/i2c-" + std::to_string(bus);
-
-    int fd = ::open(devPath.c_str(), O_RDWR);
-    if (fd < 0)
+    std::size_t slantingPos = path.find_last_of("/\\");
+    if ((slantingPos == std::string_view::npos) ||
+        ((slantingPos + 1) >= path.size()))
     {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in open!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        return -1;
+        return std::nullopt;
     }
-
-    if (::ioctl(fd, I2C_FUNCS, &funcs) < 0)
+    std::string_view statePSUName = path.substr(slantingPos + 1);
+    std::size_t hypenPos = statePSUName.find('_');
+    if (hypenPos == std::string_view::npos || hypenPos == 0)
     {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in I2C_FUNCS!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
+        return std::nullopt;
     }
+    return statePSUName.substr(0, hypenPos);
+}
 
-    if (!(funcs & I2C_FUNC_SMBUS_READ_BYTE_DATA))
+std::optional<bool> readFunctionalChange(sd_bus_message* message)
+{
+    const char* interface = nullptr;
+    if (sd_bus_message_read_basic(message, SD_BUS_TYPE_STRING, &interface) <
+            0 ||
+        sd_bus_message_enter_container(message, SD_BUS_TYPE_ARRAY, "{sv}") < 0)
     {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "i2c bus does not support read!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
+        return std::nullopt;
     }
 
-    if (::ioctl(fd, I2C_SLAVE_FORCE, slaveAddr) < 0)
+    std::optional<bool> functional;
+    int ret;
+    while ((ret = sd_bus_message_enter_container(
+                message, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0)
     {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in I2C_SLAVE_FORCE!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
+        const char* property = nullptr;
+        if (sd_bus_message_read_basic(message, SD_BUS_TYPE_STRING, &property) <
+            0)
+        {
+            return std::nullopt;
+        }
+        if (std::string_view(property) == "functional")
+        {
+            int value = 0;
+            if (sd_bus_message_enter_container(message, SD_BUS_TYPE_VARIANT,
+                                               "b") < 0 ||
+                sd_bus_message_read_basic(message, SD_BUS_TYPE_BOOLEAN,
+                                          &value) < 0 ||
+                sd_bus_message_exit_container(message) < 0)
+            {
+                return std::nullopt;
+            }
+            functional = (value != 0);
+        }
+        else if (sd_bus_message_skip(message, "v") < 0)
+        {
+            return std::nullopt;
+        }
+        if (sd_bus_message_exit_container(message) < 0)
+        {
+            return std::nullopt;
+        }
     }
-
-    value = ::i2c_smbus_read_byte_data(fd, regAddr);
-    if (value < 0)
+    if (ret < 0)
     {
-        phosphor::logging::log<phosphor::logging::level::ERR>(
-            "Error in i2c read!",
-            phosphor::logging::entry("PATH=%s", devPath.c_str()),
-            phosphor::logging::entry("SLAVEADDR=0x%x", slaveAddr));
-        ::close(fd);
-        return -1;
+        return std::nullopt;
     }
-    ::close(fd);
-    return 0;
+    return functional;
 }
 
-// Performs i2c block read
-int i2cGet(uint8_t bus, uint8_t slaveAddr, uint8_t regAddr, int readLength,
-           uint8_t* value)
+namespace
 {
-    if (value == nullptr)
-    {
-        lg2::error("i2cGet passed nullptr value array!");
-        return -1;
-    }
-
-    std::string devPath = "/dev/i2c-" + std::to_string(bus);
-
-    int fd = ::open(devPath.c_str(), O_RDWR);
-    if (fd < 0)
-    {
-        lg2::error("Error in open!", "PATH", devPath.c_str(),
-            "SLAVEADDR", lg2::hex, slaveAddr);
-        return -1;
-    }
+struct PSUEventRequest
+{
+    size_t outstanding = 0;
+    PSUStateMap states;
+    std::function<void(const PSUStateMap&)> callback;
 
-    if (::ioctl(fd, I2C_SLAVE_FORCE, slaveAddr) < 0)
+    // Called once per reply, the callback runs after the last one.
+    void finish(void)
     {
-        lg2::error("Error in I2C_SLAVE_FORCE!", "PATH", devPath.c_str(),
-            "SLAVEADDR", lg2::hex, slaveAddr);
-        ::close(fd);
-        return -1;
+        if (--outstanding == 0)
+        {
+            callback(states);
+        }
     }
+};
 
-    unsigned long funcs = 0;
-    if (::ioctl(fd, I2C_FUNCS, &funcs) < 0)
-    {
-        lg2::error("Error in I2C_FUNCS!", "PATH", devPath.c_str(),
-            "SLAVEADDR", lg2::hex, slaveAddr);
-        ::close(fd);
-        return -1;
-    }
+struct Decorator
+{
+    std::string path;
+    std::string psuName;
+    std::string interface;
+};
+} // namespace
 
-    if (!(funcs & I2C_FUNC_SMBUS_BLOCK_DATA) ||
-        !(funcs & I2C_FUNC_SMBUS_I2C_BLOCK))
-    {
-        lg2::error("i2c bus does not support block read!", "PATH", devPath.c_str(),
-            "SLAVEADDR", lg2::hex, slaveAddr);
-        ::close(fd);
-        return -1;
-    }
+static PSUState stateFromFunctional(bool functional)
+{
+    return functional ? PSUState::normal : PSUState::acLost;
+}
 
-    int length =
-        ::i2c_smbus_read_i2c_block_data(fd, regAddr, readLength, value);
-    if (length <= 0)
+// One Properties.Get per decorator, used when the owning service does not
+// serve them through an ObjectManager.
+static void getFunctional(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn,
+    const std::shared_ptr<PSUEventRequest>& request,
+    const std::string& service, const std::vector<Decorator>& decorators)
+{
+    request->outstanding += decorators.size();
+    for (const auto& decorator : decorators)
     {
-            lg2::error("Error in i2c read!", "PATH", devPath.c_str(),
-                "SLAVEADDR", lg2::hex, slaveAddr);
-        ::close(fd);
-        return -1;
+        conn->async_method_call(
+            [request, name = decorator.psuName](
+                const boost::system::error_code ec,
+                const std::variant<bool>& result) {
+                if (ec)
+                {
+                    std::cerr << "Exception happened when get functional "
+                                 "property\n";
+                }
+                else
+                {
+                    request->states[name] =
+                        stateFromFunctional(std::get<bool>(result));
+                }
+                request->finish();
+            },
+            service, decorator.path, "org.freedesktop.DBus.Properties", "Get",
+            decorator.interface, "functional");
     }
-    ::close(fd);
-    return length;
 }
 
-void getPSUEvent(const std::array<const char*, 1>& configTypes,
-                 const std::shared_ptr<sdbusplus::asio::connection>& conn,
-                 const std::string& psuName, PSUState& state)
+// Resolve the functional state of every PSU decorator. The mapper tells which
+// service owns the decorators, then one GetManagedObjects per owner returns
+// all of their states. All state the replies need is owned by the shared
+// request, so the caller may go away or change its PSU list before the
+// callback runs. The callback always runs, with the states that could be
+// resolved.
+void getPSUEvents(const std::array<const char*, 1>& configTypes,
+                  const std::shared_ptr<sdbusplus::asio::connection>& conn,
+                  std::function<void(const PSUStateMap&)>&& callback)
 {
+    auto request = std::make_shared<PSUEventRequest>();
+    request->callback = std::move(callback);
 
     conn->async_method_call(
-        [&conn, &state, &psuName, &configTypes](
-            const boost::system::error_code ec, GetSubTreeType subtree) {
+        [conn, request, configTypes](const boost::system::error_code ec,
+                                     const GetSubTreeType& subtree) {
             if (ec)
             {
                 std::cerr << "Exception happened when communicating to "
                              "ObjectMapper\n";
+                request->callback(request->states);
                 return;
             }
-            state = PSUState::normal;
 
+            boost::container::flat_map<std::string, std::vector<Decorator>>
+                byService;
             for (const auto& object : subtree)
             {
-                std::string pathStr = object.first;
-
-                // /State/Decorator/PSUx_OperationalStatus
-                auto slantingPos = pathStr.find_last_of("/\\") + 1;
-                std::string statePSUName = pathStr.substr(slantingPos);
-                auto hypenPos = statePSUName.find("_");
-
-                std::string name = statePSUName.substr(0, hypenPos);
-                if (name != psuName)
+                const std::string& pathStr = object.first;
+                auto psuName = psuNameFromStatePath(pathStr);
+                if (!psuName)
                 {
                     continue;
                 }
+
                 for (const auto& serviceIface : object.second)
                 {
-                    std::string serviceName = serviceIface.first;
                     for (const auto& interface : serviceIface.second)
                     {
                         // only get property of matched interface
-                        bool isIfaceMatched = false;
-                        for (const auto& type : configTypes)
+                        if (std::find(configTypes.begin(), configTypes.end(),
+                                      interface) == configTypes.end())
                         {
-                            if (type == interface)
-                            {
-                                isIfaceMatched = true;
-                                break;
-                            }
-                        }
-                        if (!isIfaceMatched)
                             continue;
-
-                        conn->async_method_call(
-                            [&conn, &state](const boost::system::error_code ec,
-                                            const bool& result) {
-                                if (ec)
-                                {
-                                    std::cerr << "Exception happened when get "
-                                                 "functional property\n";
-                                    return;
-                                }
-
-                                if (!result)
-                                {
-                                    state = PSUState::acLost;
-                                }
-                                return;
-                            },
-                            serviceName.c_str(), pathStr.c_str(),
-                            "org.freedesktop.DBus.Properties", "Get",
-                            interface.c_str(), "functional");
+                        }
+                        byService[serviceIface.first].push_back(
+                            {pathStr, std::string(*psuName), interface});
                     }
                 }
             }
+
+            if (byService.empty())
+            {
+                request->callback(request->states);
+                return;
+            }
+            request->outstanding = byService.size();
+            for (auto& [service, decorators] : byService)
+            {
+                conn->async_method_call(
+                    [conn, request, service = service,
+                     decorators = std::move(decorators)](
+                        const boost::system::error_code ec,
+                        const ManagedObjectType& objects) {
+                        if (ec)
+                        {
+                            // No ObjectManager at the root of the service,
+                            // or a property type the reply can not hold.
+                            getFunctional(conn, request, service, decorators);
+                            request->finish();
+                            return;
+                        }
+                        for (const auto& decorator : decorators)
+                        {
+                            auto object = objects.find(
+                                sdbusplus::message::object_path(
+                                    decorator.path));
+                            if (object == objects.end())
+                            {
+                                continue;
+                            }
+                            auto iface =
+                                object->second.find(decorator.interface);
+                            if (iface == object->second.end())
+                            {
+                                continue;
+                            }
+                            auto property = iface->second.find("functional");
+                            if (property == iface->second.end())
+                            {
+                                continue;
+                            }
+                            const bool* functional =
+                                std::get_if<bool>(&property->second);
+                            if (functional != nullptr)
+                            {
+                                request->states[decorator.psuName] =
+                                    stateFromFunctional(*functional);
+                            }
+                        }
+                        request->finish();
+                    },
+                    service, "/", "org.freedesktop.DBus.ObjectManager",
+                    "GetManagedObjects");
+            }
         },
         "xyz.openbmc_project.ObjectMapper",
         "/xyz/openbmc_project/object_mapper",